@@ -36,6 +36,21 @@ Steps to compile and run this code:
 
    This will give you a detailed breakdown of system calls and their usage for both types of locks.
 
+   You can also pick a queue-based lock (see include/thread-sync.h) from the command line
+   instead of editing the file, and compare how they scale:
+
+   gcc -O2 -DUSE_TICKET 10_spin_scalability.c
+   gcc -O2 -DUSE_MCS 10_spin_scalability.c
+   gcc -O2 -DUSE_CLH 10_spin_scalability.c
+
+   With more threads than cores, a queue lock's waiters yield the CPU after
+   QLOCK_YIELD_AFTER (default 128) rounds, so that the waiter whose turn has
+   come gets to run. -DQLOCK_YIELD_AFTER=0 disables this: watch the program
+   crawl (or hang) with 8 threads on fewer cores.
+
+   For a full sweep (thread counts, critical-section and think-time lengths,
+   pinning, latency percentiles as CSV) use the benchmark in lock-bench/.
+
 7. You can also compare the performance of locking with atomic instructions:
    - Comment out the `Txpp` function.
    - Uncomment the atomic instruction-based `Txpp` function (if available).
@@ -52,21 +67,43 @@ Steps to compile and run this code:
 #include <unistd.h>
 #include <sys/time.h>
 #include <stdatomic.h>  // Add this for atomic operations
+#include "include/thread-sync.h"  // Ticket, MCS and CLH locks
 
-// Choose between spinlock and mutex
-// Uncomment one of the following lines to select the locking mechanism
+// Choose the locking mechanism
+// Uncomment one of the following lines (or pass -DUSE_xxx to gcc)
+#if !defined(USE_MUTEX) && !defined(USE_TICKET) && !defined(USE_MCS) && !defined(USE_CLH)
 #define USE_SPINLOCK
+#endif
 // #define USE_MUTEX
+// #define USE_TICKET
+// #define USE_MCS
+// #define USE_CLH
 
 // Shared variables
 #define NUM_INCREMENTS 1000000
 long x = 0;
 
 // Lock Implementation
-#ifdef USE_SPINLOCK
+#if defined(USE_SPINLOCK)
 int lock = 0;  // Spinlock (0 means unlocked, 1 means locked)
+#define LOCK()   acquire_lock(&lock)
+#define UNLOCK() release_lock(&lock)
+#elif defined(USE_TICKET)
+ticket_lock_t lock = TICKET_INIT();
+#define LOCK()   ticket_lock(&lock)
+#define UNLOCK() ticket_unlock(&lock)
+#elif defined(USE_MCS)
+mcs_lock_t lock = MCS_INIT();
+#define LOCK()   mcs_lock(&lock)
+#define UNLOCK() mcs_unlock(&lock)
+#elif defined(USE_CLH)
+clh_lock_t lock = CLH_INIT();
+#define LOCK()   clh_lock(&lock)
+#define UNLOCK() clh_unlock(&lock)
 #else
 pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK()   pthread_mutex_lock(&lock)
+#define UNLOCK() pthread_mutex_unlock(&lock)
 #endif
 
 
@@ -98,19 +135,11 @@ void release_lock(int *lock) {
 
 void *Txpp(void *arg) {
     for (int i = 0; i < NUM_INCREMENTS; i++) {
-    #ifdef USE_SPINLOCK
-        acquire_lock(&lock);  // Using the new xchg-based spinlock implementation
-    #else
-        pthread_mutex_lock(&lock);
-    #endif
+        LOCK();    // Acquire the selected lock
 
         x++;
 
-    #ifdef USE_SPINLOCK
-        release_lock(&lock);  // Release the xchg-based spinlock
-    #else
-        pthread_mutex_unlock(&lock);
-    #endif
+        UNLOCK();  // Release the selected lock
     }
     return NULL;
 }
@@ -15,18 +15,72 @@
  * 5. To check the result using a pipe and an external Python script (checker.py):
  *    ./a.out 2 | python3 pc_checker.py 2
  *    Here, '2' is the buffer size passed to both the C program and the Python checker.
+ *
+ * 6. Batched mode: pass a batch size B as the second argument, for example:
+ *    ./a.out 32 8 | python3 pc_checker.py 32
+ *    Each producer/consumer now waits on a condition variable instead of retrying,
+ *    claims up to B slots per lock acquisition, and prints them from a per-thread
+ *    buffer after releasing the lock (in the order the batches were claimed).
+ *    A batch size of 0 selects the original busy-retry code.
+ *
+ * 7. Measuring: pass a duration in seconds as the third argument. The program stops
+ *    after that time and reports items/s and CPU time per item on stderr:
+ *    ./a.out 32 0 5 > /dev/null     (original busy-retry loop)
+ *    ./a.out 32 8 5 > /dev/null     (batches of 8)
  */
 
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/resource.h>
+#include <sys/time.h>
 
 // Global variables
 // n: The buffer size (maximum number of items the producer can produce before the buffer is full)
 // count: The current number of items in the buffer, shared between producers and consumers
-int n, count = 0;
+// batch: the maximum number of slots claimed per lock acquisition (0: original code)
+// consumed: the total number of consumed items, for measurement
+int n, count = 0, batch = 0;
+long consumed = 0;
 pthread_mutex_t lk = PTHREAD_MUTEX_INITIALIZER; // Mutex to protect access to the shared 'count' variable
+pthread_cond_t not_full = PTHREAD_COND_INITIALIZER;  // Batched mode only
+pthread_cond_t not_empty = PTHREAD_COND_INITIALIZER; // Batched mode only
+
+// Batched mode prints outside of 'lk'. Each batch takes a ticket while it
+// still holds 'lk', and batches are written in ticket order, so the output
+// still matches the buffer history and pc_checker.py can verify it.
+long tickets = 0, printed = 0;  // 'tickets' is protected by 'lk'
+pthread_mutex_t out_lk = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t out_turn = PTHREAD_COND_INITIALIZER;
+
+// Write all of buf, retrying after partial writes and interrupts
+void write_all(const char *buf, int len) {
+  while (len > 0) {
+    ssize_t r = write(STDOUT_FILENO, buf, len);
+    if (r < 0) {
+      if (errno == EINTR) continue;
+      perror("write");
+      exit(1);
+    }
+    buf += r;
+    len -= r;
+  }
+}
+
+// Print batch 'ticket' once all batches before it have been printed
+void print_batch(long ticket, const char *buf, int len) {
+  pthread_mutex_lock(&out_lk);
+  while (printed != ticket) {
+    pthread_cond_wait(&out_turn, &out_lk);
+  }
+  write_all(buf, len);
+  printed++;
+  pthread_cond_broadcast(&out_turn);
+  pthread_mutex_unlock(&out_lk);
+}
 
 // Producer thread function
 void *Tproduce(void *arg) {
@@ -54,23 +108,91 @@ retry:
       goto retry;
     }
     count--;                  // Decrease the buffer count (consuming an item)
+    consumed++;
     printf("X");              // Print 'X' to indicate a consumed item
     pthread_mutex_unlock(&lk); // Unlock the mutex after modifying the shared variable
   }
   return NULL;
 }
 
+// Batched producer: wait (no busy retry) until there is room, then fill as many
+// slots as possible (up to 'batch') under a single lock acquisition
+void *Tproduce_batch(void *arg) {
+  char *out = malloc(batch);  // Per-thread output buffer
+  assert(out);
+  while (1) {
+    pthread_mutex_lock(&lk);
+    while (count == n) {
+      pthread_cond_wait(&not_full, &lk);
+    }
+    int k = n - count < batch ? n - count : batch;
+    count += k;
+    for (int i = 0; i < k; i++) out[i] = 'O';
+    long ticket = tickets++;
+    pthread_cond_broadcast(&not_empty);
+    pthread_mutex_unlock(&lk);
+    print_batch(ticket, out, k);
+  }
+  return NULL;
+}
+
+// Batched consumer: take as many items as possible (up to 'batch') at once
+void *Tconsume_batch(void *arg) {
+  char *out = malloc(batch);  // Per-thread output buffer
+  assert(out);
+  while (1) {
+    pthread_mutex_lock(&lk);
+    while (count == 0) {
+      pthread_cond_wait(&not_empty, &lk);
+    }
+    int k = count < batch ? count : batch;
+    count -= k;
+    consumed += k;
+    for (int i = 0; i < k; i++) out[i] = 'X';
+    long ticket = tickets++;
+    pthread_cond_broadcast(&not_full);
+    pthread_mutex_unlock(&lk);
+    print_batch(ticket, out, k);
+  }
+  return NULL;
+}
+
+// Sleep for 'secs' seconds, then report throughput and CPU cost per item
+void measure(double secs) {
+  struct timeval t0, t1;
+  gettimeofday(&t0, NULL);
+  usleep(secs * 1000000);
+
+  pthread_mutex_lock(&lk);
+  long items = consumed;
+  gettimeofday(&t1, NULL);
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  double wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) / 1e6;
+  double cpu = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+               ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+  fprintf(stderr, "\nmode=%s n=%d batch=%d: %ld items, %.0f items/s, %.1f ns CPU/item\n",
+          batch ? "batched" : "busy-retry", n, batch, items, items / wall,
+          items ? cpu * 1e9 / items : 0.0);
+  exit(0);
+}
+
 int main(int argc, char *argv[]) {
-  assert(argc == 2);           // Ensure the program is run with a buffer size argument
+  assert(argc >= 2 && argc <= 4); // Buffer size, and optionally batch size and duration
   n = atoi(argv[1]);           // Set the buffer size to the value passed as a command-line argument
+  if (argc >= 3) batch = atoi(argv[2]);
   setbuf(stdout, NULL);        // Disable output buffering to see real-time output in the console
 
   pthread_t producers[8], consumers[8]; // Create arrays for 8 producer and 8 consumer threads
 
   // Create 8 producer and 8 consumer threads
   for (int i = 0; i < 8; i++) {
-    pthread_create(&producers[i], NULL, Tproduce, NULL); // Create a producer thread
-    pthread_create(&consumers[i], NULL, Tconsume, NULL); // Create a consumer thread
+    pthread_create(&producers[i], NULL, batch ? Tproduce_batch : Tproduce, NULL); // Create a producer thread
+    pthread_create(&consumers[i], NULL, batch ? Tconsume_batch : Tconsume, NULL); // Create a consumer thread
+  }
+
+  if (argc == 4) {
+    measure(atof(argv[3]));    // Stop after the given number of seconds
   }
 
   // Wait for all producer and consumer threads to finish (they won't finish in this case due to infinite loop)
@@ -24,6 +24,7 @@ Steps to compile and run this code:
 
 
 #include "include/thread.h"
+#include <immintrin.h>
 #include <math.h>
 
 int NT;
@@ -31,66 +32,250 @@ int NT;
 #define H 12800
 #define IMG_FILE "./mandelbrot.ppm"
 
-static inline int belongs(int x, int y, int t) {
-  return x / (W / NT) == t;
+// Work is split into TILE x TILE tiles, which threads claim one at a time
+// from a shared counter. Expensive tiles (near the set) and cheap ones are
+// interleaved, so no thread sits idle while another finishes a costly
+// slab, and each thread only visits the pixels it actually renders.
+#define TILE 64
+#define TILES_X (W / TILE)
+#define TILES_Y (H / TILE)
+
+// Row-major framebuffer: x[j][i] is pixel (i, j), so a row of the image
+// is contiguous for both the kernels and the PPM writer.
+int x[H][W];
+atomic_int next_tile = 0;
+atomic_int done = 0;
+
+// Escape-time kernels
+//
+// x[j][i] is the number of iterations pixel (i, j) stays inside |z| < 2,
+// capped at 881. A kernel computes n consecutive pixels of row j, whose
+// real parts are re[0..n). The SIMD kernels iterate 4 (AVX2) or 8
+// (AVX-512) pixels at once, keep the counters in registers, and mask out
+// lanes that escaped. They perform exactly the scalar operations in the
+// same order, and contraction into FMA is disabled everywhere, so all
+// kernels give bit-identical iteration counts.
+#define MAXITER 880
+#define RE0 0.356888
+#define IM0 0.645411
+#define KERNEL __attribute__((optimize("fp-contract=off")))
+
+// Pixel offsets from (RE0, -IM0); the offsets are added last, as in
+// c - d + i * 1024.0 / W * 8e-9 + RE0, to keep the original rounding.
+double re_of[W], im_of[H];
+
+KERNEL void init_coords() {
+  for (int i = 0; i < W; i++) re_of[i] = i * 1024.0 / W * 8e-9;
+  for (int j = 0; j < H; j++) im_of[j] = j * 1024.0 / H * 8e-9;
 }
 
-int x[W][H];
-int volatile done = 0;
+KERNEL void kernel_scalar(int *out, const double *re, double im, int n) {
+  for (int k = 0; k < n; k++) {
+    double a = 0, b = 0, c, d;
+    int cnt = 0;
+    while ((c = a * a) + (d = b * b) < 4 && cnt++ < MAXITER) {
+      b = 2 * a * b + im - IM0;
+      a = c - d + re[k] + RE0;
+    }
+    out[k] = cnt;
+  }
+}
 
-void display(FILE *fp, int step) { 
-  static int rnd = 1;
-  int w = W / step, h = H / step;
-  // STFW: Portable Pixel Map
-  fprintf(fp, "P6\n %d %d 255\n", w, h);
-  for (int j = 0; j < H; j += step) {
-    for (int i = 0; i < W; i += step) {
-      int n = x[i][j];
-      int r = 255 * pow((n - 80) / 800.0, 3);
-      int g = 255 * pow((n - 80) / 800.0, 0.7);
-      int b = 255 * pow((n - 80) / 800.0, 0.5);
-      fputc(r, fp); fputc(g, fp); fputc(b, fp);
+__attribute__((target("avx2"))) KERNEL
+void kernel_avx2(int *out, const double *re, double im, int n) {
+  const __m256d two = _mm256_set1_pd(2), four = _mm256_set1_pd(4),
+                one = _mm256_set1_pd(1), cim = _mm256_set1_pd(im),
+                re0 = _mm256_set1_pd(RE0), im0 = _mm256_set1_pd(IM0);
+  int k = 0;
+  for (; k + 4 <= n; k += 4) {
+    __m256d cre = _mm256_loadu_pd(re + k);
+    __m256d a = _mm256_setzero_pd(), b = _mm256_setzero_pd();
+    __m256d cnt = _mm256_setzero_pd();
+    __m256d active = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    for (int it = 0; it <= MAXITER; it++) {
+      __m256d c = _mm256_mul_pd(a, a), d = _mm256_mul_pd(b, b);
+      active = _mm256_and_pd(active,
+          _mm256_cmp_pd(_mm256_add_pd(c, d), four, _CMP_LT_OQ));
+      if (_mm256_movemask_pd(active) == 0) break;
+      cnt = _mm256_add_pd(cnt, _mm256_and_pd(active, one));
+      b = _mm256_sub_pd(
+          _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(two, a), b), cim), im0);
+      a = _mm256_add_pd(_mm256_add_pd(_mm256_sub_pd(c, d), cre), re0);
+    }
+    _mm_storeu_si128((__m128i *)(out + k), _mm256_cvtpd_epi32(cnt));
+  }
+  kernel_scalar(out + k, re + k, im, n - k);
+}
+
+__attribute__((target("avx512f"))) KERNEL
+void kernel_avx512(int *out, const double *re, double im, int n) {
+  const __m512d two = _mm512_set1_pd(2), four = _mm512_set1_pd(4),
+                one = _mm512_set1_pd(1), cim = _mm512_set1_pd(im),
+                re0 = _mm512_set1_pd(RE0), im0 = _mm512_set1_pd(IM0);
+  int k = 0;
+  for (; k + 8 <= n; k += 8) {
+    __m512d cre = _mm512_loadu_pd(re + k);
+    __m512d a = _mm512_setzero_pd(), b = _mm512_setzero_pd();
+    __m512d cnt = _mm512_setzero_pd();
+    __mmask8 active = 0xff;
+    for (int it = 0; it <= MAXITER; it++) {
+      __m512d c = _mm512_mul_pd(a, a), d = _mm512_mul_pd(b, b);
+      active = _mm512_mask_cmp_pd_mask(active, _mm512_add_pd(c, d), four,
+                                       _CMP_LT_OQ);
+      if (active == 0) break;
+      cnt = _mm512_mask_add_pd(cnt, active, cnt, one);
+      b = _mm512_sub_pd(
+          _mm512_add_pd(_mm512_mul_pd(_mm512_mul_pd(two, a), b), cim), im0);
+      a = _mm512_add_pd(_mm512_add_pd(_mm512_sub_pd(c, d), cre), re0);
     }
+    _mm256_storeu_si256((__m256i *)(out + k), _mm512_cvtpd_epi32(cnt));
+  }
+  kernel_scalar(out + k, re + k, im, n - k);
+}
+
+void (*kernel)(int *, const double *, double, int) = kernel_scalar;
+
+// Pick the widest kernel the CPU supports; MANDELBROT_KERNEL=scalar|avx2
+// forces a narrower one (e.g. to compare speed or check identical output).
+void select_kernel() {
+  const char *want = getenv("MANDELBROT_KERNEL");
+  __builtin_cpu_init();
+  if (want && strcmp(want, "scalar") == 0) return;
+  if (__builtin_cpu_supports("avx512f") && !(want && strcmp(want, "avx2") == 0)) {
+    kernel = kernel_avx512;
+  } else if (__builtin_cpu_supports("avx2")) {
+    kernel = kernel_avx2;
   }
 }
 
+// Colors of all possible iteration counts (0..MAXITER + 1), so the image
+// writers do no pow() per pixel. Same formula (and rounding) as before.
+unsigned char palette[MAXITER + 2][3];
+
+void init_palette() {
+  for (int n = 0; n <= MAXITER + 1; n++) {
+    int r = 255 * pow((n - 80) / 800.0, 3);
+    int g = 255 * pow((n - 80) / 800.0, 0.7);
+    int b = 255 * pow((n - 80) / 800.0, 0.5);
+    palette[n][0] = r; palette[n][1] = g; palette[n][2] = b;
+  }
+}
+
+// Finished tiles are published in a lock-free bitmap (for the preview)
+// and in a per-band count of unfinished tiles (for the file writer). The
+// release/acquire pair makes a tile's pixels visible before anybody reads
+// them; readers never look at a tile that is still being rendered.
+#define NTILES (TILES_X * TILES_Y)
+#define NWORDS ((NTILES + 63) / 64)
+
+atomic_ulong tile_done[NWORDS];
+atomic_int band_left[TILES_Y];  // Unfinished tiles in each row of tiles
+
+void publish_tile(int tile) {
+  atomic_fetch_or_explicit(&tile_done[tile / 64], 1UL << (tile % 64),
+                           memory_order_release);
+  atomic_fetch_sub_explicit(&band_left[tile / TILES_X], 1,
+                            memory_order_release);
+}
+
+void render_tile(int tile) {
+  int i0 = (tile % TILES_X) * TILE, j0 = (tile / TILES_X) * TILE;
+  for (int j = j0; j < j0 + TILE; j++)
+    kernel(&x[j][i0], &re_of[i0], im_of[j], TILE);
+}
+
 void Tworker(int tid) {
-  for (int i = 0; i < W; i++)
-    for (int j = 0; j < H; j++)
-      if (belongs(i, j, tid - 1)) {
-        double a = 0, b = 0, c, d;
-        while ((c = a * a) + (d = b * b) < 4 && x[i][j]++ < 880) {
-          b = 2 * a * b + j * 1024.0 / H * 8e-9 - 0.645411;
-          a = c - d + i * 1024.0 / W * 8e-9 + 0.356888;
-        }
-      }
+  int tile;
+  while ((tile = atomic_fetch_add(&next_tile, 1)) < NTILES) {
+    render_tile(tile);
+    publish_tile(tile);
+  }
   done++;
 }
 
+// Preview: a PW x PH image sampling every PREVIEW_STEP-th pixel. Only
+// tiles finished since the last refresh are encoded into it; unfinished
+// tiles stay black.
+#define PREVIEW_STEP (W / 256)
+#define PW (W / PREVIEW_STEP)
+#define PH (H / PREVIEW_STEP)
+
+unsigned char preview[PH][PW][3];
+
+void preview_tile(int tile) {
+  int i0 = (tile % TILES_X) * TILE, j0 = (tile / TILES_X) * TILE;
+  int i1 = (i0 + PREVIEW_STEP - 1) / PREVIEW_STEP * PREVIEW_STEP;
+  int j1 = (j0 + PREVIEW_STEP - 1) / PREVIEW_STEP * PREVIEW_STEP;
+  for (int j = j1; j < j0 + TILE; j += PREVIEW_STEP)
+    for (int i = i1; i < i0 + TILE; i += PREVIEW_STEP)
+      memcpy(preview[j / PREVIEW_STEP][i / PREVIEW_STEP], palette[x[j][i]], 3);
+}
+
 void Tdisplay() {
+  unsigned long seen[NWORDS] = {};
   float ms = 0;
   while (1) {
+    int finished = done == NT;  // Checked first: the scan below sees every tile
+    for (int w = 0; w < NWORDS; w++) {
+      unsigned long fresh =
+          atomic_load_explicit(&tile_done[w], memory_order_acquire) & ~seen[w];
+      seen[w] |= fresh;
+      for (; fresh; fresh &= fresh - 1) {
+        preview_tile(w * 64 + __builtin_ctzl(fresh));
+      }
+    }
+
     FILE *fp = popen("viu -", "w"); assert(fp);
-    display(fp, W / 256);
+    // STFW: Portable Pixel Map
+    fprintf(fp, "P6\n %d %d 255\n", PW, PH);
+    fwrite(preview, 3, PW * PH, fp);
     pclose(fp);
-    if (done == NT) break;
+    if (finished) break;
     usleep(1000000 / 5);
     ms += 1000.0 / 5;
   }
   printf("Approximate render time: %.1lfs\n", ms / 1000);
+}
+
+// Writes the final image (every 2nd pixel) one band of tiles at a time, as
+// soon as the band is complete, so the output overlaps with rendering.
+void Twriter() {
+  const int step = 2, w = W / step, h = H / step;
+  unsigned char *row = malloc(w * 3);
+  assert(row);
 
   FILE *fp = fopen(IMG_FILE, "w"); assert(fp);
-  display(fp, 2);
+  fprintf(fp, "P6\n %d %d 255\n", w, h);
+  for (int band = 0; band < TILES_Y; band++) {
+    while (atomic_load_explicit(&band_left[band], memory_order_acquire) > 0) {
+      usleep(1000);
+    }
+    for (int j = band * TILE; j < (band + 1) * TILE; j += step) {
+      unsigned char *p = row;
+      for (int i = 0; i < W; i += step, p += 3) {
+        memcpy(p, palette[x[j][i]], 3);
+      }
+      fwrite(row, 3, w, fp);  // One write per row, not three fputc()s per pixel
+    }
+  }
   fclose(fp);
+  free(row);
 }
 
 int main(int argc, char *argv[]) {
   assert(argc == 2);
   NT = atoi(argv[1]);
+  init_coords();
+  init_palette();
+  select_kernel();
+  for (int b = 0; b < TILES_Y; b++) {
+    band_left[b] = TILES_X;
+  }
   for (int i = 0; i < NT; i++) {
     create(Tworker);
   }
   create(Tdisplay);
+  create(Twriter);
   join();
   return 0;
 }
@@ -13,6 +13,9 @@ Steps to compile and run this code:
 4.  Use `objdump` to inspect the generated assembly instructions:
     objdump -d a.out
     (This command disassembles the executable so you can observe the actual assembly instructions that the CPU will execute. You can see how the high-level code is broken down into assembly.)
+
+5.  The result is correct, but every `lock addq` needs the cache line holding `x`, so adding threads does not make counting faster.
+    See counter-bench/ for sharded per-thread counters (include/counter.h) and a comparison with the atomic and locked versions.
 */
 
 
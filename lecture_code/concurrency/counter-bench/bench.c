@@ -0,0 +1,110 @@
+#include "thread.h"
+#include "thread-sync.h"
+#include "counter.h"
+#include <string.h>
+#include <time.h>
+
+// Shared-counter throughput: the x++ demos (one lock-protected or atomic
+// counter) against the sharded counters of include/counter.h. Every thread
+// performs n increments; the final value is checked against the expected
+// total. Output is CSV.
+
+static long n;
+
+// 9_x++_xchg.c and pthread mutex: a lock around x++
+
+static long x;
+static spinlock_t spin = SPIN_INIT();
+static mutex_t mutex = MUTEX_INIT();
+
+static void Tspin() {
+  for (long i = 0; i < n; i++) {
+    spin_lock(&spin);
+    x++;
+    spin_unlock(&spin);
+  }
+}
+
+static void Tmutex() {
+  for (long i = 0; i < n; i++) {
+    mutex_lock(&mutex);
+    x++;
+    mutex_unlock(&mutex);
+  }
+}
+
+// 8_x++_atomic.c: lock addq
+
+static void Tatomic() {
+  for (long i = 0; i < n; i++) {
+    asm volatile("lock addq $1, %0" : "+m"(x));
+  }
+}
+
+// include/counter.h
+
+static counter_t sharded = COUNTER_INIT();
+static approx_counter_t approx = APPROX_COUNTER_INIT(1024);
+
+static void Tsharded() {
+  for (long i = 0; i < n; i++) {
+    counter_inc(&sharded);
+  }
+}
+
+static void Tapprox() {
+  for (long i = 0; i < n; i++) {
+    approx_inc(&approx);
+  }
+  approx_flush(&approx);
+}
+
+static long read_x() { return x; }
+static long read_sharded() { return counter_read(&sharded); }
+static long read_approx() { return approx_read(&approx); }
+
+static struct variant {
+  const char *name;
+  void (*worker)();
+  long (*read)();
+} variants[] = {
+  { "spin",    Tspin,    read_x },
+  { "mutex",   Tmutex,   read_x },
+  { "atomic",  Tatomic,  read_x },
+  { "sharded", Tsharded, read_sharded },
+  { "approx",  Tapprox,  read_approx },
+};
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Usage: ./bench [increments per thread] [variant]
+int main(int argc, char *argv[]) {
+  n = argc > 1 ? atol(argv[1]) : 10000000;
+  const char *only = argc > 2 ? argv[2] : NULL;
+  int nthreads[] = { 1, 2, 4, 8, 16 };
+
+  printf("variant,threads,increments,seconds,ops_per_sec,value,expected\n");
+  for (int i = 0; i < sizeof(variants) / sizeof(variants[0]); i++) {
+    struct variant *v = &variants[i];
+    if (only && strcmp(only, v->name) != 0) continue;
+    for (int t = 0; t < sizeof(nthreads) / sizeof(nthreads[0]); t++) {
+      long before = v->read();
+      double t0 = now();
+      for (int k = 0; k < nthreads[t]; k++) {
+        create(v->worker);
+      }
+      join();
+      double elapsed = now() - t0;
+      long total = nthreads[t] * n;
+
+      printf("%s,%d,%ld,%.3f,%.0f,%ld,%ld\n", v->name, nthreads[t], total,
+             elapsed, total / elapsed, v->read() - before, total);
+      fflush(stdout);
+    }
+  }
+  return 0;
+}
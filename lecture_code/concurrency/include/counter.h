@@ -0,0 +1,144 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Sharded counters
+//
+// In 2_x++.c, 8_x++_atomic.c, 9_x++_xchg.c and sum-locked/sum.c every
+// increment goes through the same cache line, which has to travel to the
+// incrementing core each time: more threads only make it slower. A
+// sharded counter gives each thread its own slot, padded to a cache line,
+// so an increment is a plain load and store to a line nobody else writes.
+// Reading sums all slots; the result is exact once the writers are done,
+// and a consistent-enough snapshot while they run (fine for statistics).
+//
+// Each thread claims the lowest free slot index on its first increment
+// and gives it back when it exits, so slots are reused across short-lived
+// threads. Values stay in a slot after its owner exits; the next owner
+// keeps adding to it. Threads beyond COUNTER_SLOTS share one atomic
+// overflow slot.
+//
+// The approximate counter additionally keeps a global total, to which a
+// thread flushes its slot every `batch` increments. approx_read() is then
+// a single load, off by at most (batch - 1) per thread.
+
+#define COUNTER_SLOTS 64  // One bit of counter_ids each
+
+struct counter_slot {
+  _Alignas(64) long val;
+};
+
+typedef struct {
+  struct counter_slot slot[COUNTER_SLOTS];
+  _Alignas(64) atomic_long overflow;
+} counter_t;
+#define COUNTER_INIT() {}
+
+typedef struct {
+  struct counter_slot slot[COUNTER_SLOTS];
+  _Alignas(64) atomic_long global;
+  long batch;
+} approx_counter_t;
+#define APPROX_COUNTER_INIT(b) { .batch = (b) }
+
+static atomic_ulong counter_ids;  // Bit k set: slot k is owned
+static pthread_key_t counter_key;
+static pthread_once_t counter_once = PTHREAD_ONCE_INIT;
+static __thread int counter_id = -1;  // -1: not claimed yet
+
+static void counter_release(void *arg) {
+  // Called at thread exit; our last stores happen-before the next owner's.
+  int id = (intptr_t)arg - 1;
+  atomic_fetch_and_explicit(&counter_ids, ~(1UL << id), memory_order_release);
+}
+
+static void counter_key_init() {
+  int ret = pthread_key_create(&counter_key, counter_release);
+  assert(ret == 0);
+}
+
+static int counter_claim() {
+  pthread_once(&counter_once, counter_key_init);
+  unsigned long ids = atomic_load_explicit(&counter_ids, memory_order_relaxed);
+  while (~ids) {
+    int id = __builtin_ctzl(~ids);
+    if (atomic_compare_exchange_weak_explicit(&counter_ids, &ids,
+            ids | (1UL << id), memory_order_acquire, memory_order_relaxed)) {
+      pthread_setspecific(counter_key, (void *)(intptr_t)(id + 1));
+      return id;
+    }
+  }
+  return COUNTER_SLOTS;  // All taken: use the overflow slot
+}
+
+static inline int counter_slot_id() {
+  if (counter_id < 0) counter_id = counter_claim();
+  return counter_id;
+}
+
+static inline void slot_add(struct counter_slot *s, long n) {
+  // Only the owner writes the slot; readers may load it concurrently.
+  __atomic_store_n(&s->val, __atomic_load_n(&s->val, __ATOMIC_RELAXED) + n,
+                   __ATOMIC_RELAXED);
+}
+
+static inline void counter_add(counter_t *c, long n) {
+  int id = counter_slot_id();
+  if (id < COUNTER_SLOTS) {
+    slot_add(&c->slot[id], n);
+  } else {
+    atomic_fetch_add_explicit(&c->overflow, n, memory_order_relaxed);
+  }
+}
+
+static inline void counter_inc(counter_t *c) { counter_add(c, 1); }
+
+long counter_read(counter_t *c) {
+  long sum = atomic_load_explicit(&c->overflow, memory_order_relaxed);
+  for (int i = 0; i < COUNTER_SLOTS; i++) {
+    sum += __atomic_load_n(&c->slot[i].val, __ATOMIC_RELAXED);
+  }
+  return sum;
+}
+
+static inline void approx_add(approx_counter_t *c, long n) {
+  int id = counter_slot_id();
+  if (id < COUNTER_SLOTS) {
+    struct counter_slot *s = &c->slot[id];
+    long val = s->val + n;
+    if (val >= c->batch || val <= -c->batch) {
+      atomic_fetch_add_explicit(&c->global, val, memory_order_relaxed);
+      val = 0;
+    }
+    __atomic_store_n(&s->val, val, __ATOMIC_RELAXED);
+  } else {
+    atomic_fetch_add_explicit(&c->global, n, memory_order_relaxed);
+  }
+}
+
+static inline void approx_inc(approx_counter_t *c) { approx_add(c, 1); }
+
+// Push this thread's pending count to the global total (e.g., before the
+// thread exits, so approx_read() no longer misses it).
+void approx_flush(approx_counter_t *c) {
+  int id = counter_slot_id();
+  if (id < COUNTER_SLOTS) {
+    long val = __atomic_exchange_n(&c->slot[id].val, 0, __ATOMIC_RELAXED);
+    atomic_fetch_add_explicit(&c->global, val, memory_order_relaxed);
+  }
+}
+
+long approx_read(approx_counter_t *c) {
+  return atomic_load_explicit(&c->global, memory_order_relaxed);
+}
+
+// Global total plus all pending slots. Exact when no thread is adding; a
+// concurrent flush may be seen twice or not at all.
+long approx_read_exact(approx_counter_t *c) {
+  long sum = approx_read(c);
+  for (int i = 0; i < COUNTER_SLOTS; i++) {
+    sum += __atomic_load_n(&c->slot[i].val, __ATOMIC_RELAXED);
+  }
+  return sum;
+}
@@ -0,0 +1,154 @@
+#include <assert.h>
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Bounded lock-free MPMC queue (Dmitry Vyukov's sequence-numbered ring)
+//
+// Every cell carries a sequence number. A producer at position pos may
+// fill cell[pos & mask] when cell.seq == pos; it then publishes the item
+// by setting seq = pos + 1. A consumer at pos may take the item when
+// seq == pos + 1, and recycles the cell for the next lap with
+// seq = pos + capacity. Producers and consumers only contend on their own
+// counter (head or tail), each on its own cache line.
+//
+// ring_push()/ring_pop() block on a futex when the ring is full/empty. The
+// futex words are event counters: a waiter reads the counter, registers
+// itself, re-checks the ring and sleeps only if the counter is unchanged.
+// The other side bumps the counter and wakes one waiter only when someone
+// is registered, so the uncontended path makes no system calls.
+
+struct ring_cell {
+  atomic_size_t seq;
+  void *data;
+};
+
+typedef struct {
+  size_t mask;
+  struct ring_cell *cells;
+  _Alignas(64) atomic_size_t head;  // Next position to push
+  _Alignas(64) atomic_size_t tail;  // Next position to pop
+  _Alignas(64) atomic_uint not_full, not_empty;  // Futex event counters
+  atomic_int wait_full, wait_empty;              // Registered waiters
+} ring_t;
+
+#define RING_SPIN 128  // Failed tries before sleeping on the futex
+
+static inline void futex_wait(atomic_uint *addr, unsigned val) {
+  syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static inline void futex_wake(atomic_uint *addr, int n) {
+  syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+// Capacity is rounded up to a power of two, and to at least 2: with a
+// single cell, "empty at pos + 1" and "full at pos" share a sequence number.
+void ring_init(ring_t *r, size_t capacity) {
+  size_t n = 2;
+  while (n < capacity) n <<= 1;
+
+  *r = (ring_t){ .mask = n - 1 };
+  r->cells = aligned_alloc(64, (n * sizeof(struct ring_cell) + 63) & ~63UL);
+  assert(r->cells);
+  for (size_t i = 0; i < n; i++) {
+    atomic_init(&r->cells[i].seq, i);
+  }
+}
+
+void ring_destroy(ring_t *r) { free(r->cells); }
+
+bool ring_try_push(ring_t *r, void *item) {
+  size_t pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+  while (1) {
+    struct ring_cell *cell = &r->cells[pos & r->mask];
+    size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+    intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+    if (dif == 0) {
+      if (atomic_compare_exchange_weak_explicit(&r->head, &pos, pos + 1,
+              memory_order_relaxed, memory_order_relaxed)) {
+        cell->data = item;
+        atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+        return true;
+      }
+    } else if (dif < 0) {
+      return false;  // Full: the cell still holds last lap's item
+    } else {
+      pos = atomic_load_explicit(&r->head, memory_order_relaxed);
+    }
+  }
+}
+
+bool ring_try_pop(ring_t *r, void **item) {
+  size_t pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  while (1) {
+    struct ring_cell *cell = &r->cells[pos & r->mask];
+    size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+    intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+    if (dif == 0) {
+      if (atomic_compare_exchange_weak_explicit(&r->tail, &pos, pos + 1,
+              memory_order_relaxed, memory_order_relaxed)) {
+        *item = cell->data;
+        atomic_store_explicit(&cell->seq, pos + r->mask + 1,
+                              memory_order_release);
+        return true;
+      }
+    } else if (dif < 0) {
+      return false;  // Empty: no producer has filled this cell yet
+    } else {
+      pos = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    }
+  }
+}
+
+static inline void ring_notify(atomic_uint *event, atomic_int *waiters) {
+  // Order our (release) update of the ring before reading `waiters`; the
+  // waiter orders its registration before re-checking the ring.
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load(waiters) > 0) {
+    atomic_fetch_add(event, 1);
+    futex_wake(event, 1);
+  }
+}
+
+void ring_push(ring_t *r, void *item) {
+  for (int i = 0; !ring_try_push(r, item); i++) {
+    if (i < RING_SPIN) {
+      asm volatile("pause" ::: "memory");
+      continue;
+    }
+    unsigned ev = atomic_load(&r->not_full);
+    atomic_fetch_add(&r->wait_full, 1);
+    if (ring_try_push(r, item)) {
+      atomic_fetch_sub(&r->wait_full, 1);
+      break;
+    }
+    futex_wait(&r->not_full, ev);
+    atomic_fetch_sub(&r->wait_full, 1);
+  }
+  ring_notify(&r->not_empty, &r->wait_empty);
+}
+
+void *ring_pop(ring_t *r) {
+  void *item;
+  for (int i = 0; !ring_try_pop(r, &item); i++) {
+    if (i < RING_SPIN) {
+      asm volatile("pause" ::: "memory");
+      continue;
+    }
+    unsigned ev = atomic_load(&r->not_empty);
+    atomic_fetch_add(&r->wait_empty, 1);
+    if (ring_try_pop(r, &item)) {
+      atomic_fetch_sub(&r->wait_empty, 1);
+      break;
+    }
+    futex_wait(&r->not_empty, ev);
+    atomic_fetch_sub(&r->wait_empty, 1);
+  }
+  ring_notify(&r->not_full, &r->wait_full);
+  return item;
+}
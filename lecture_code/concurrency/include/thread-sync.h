@@ -1,6 +1,13 @@
+#include <assert.h>
+#include <linux/futex.h>
 #include <pthread.h>
+#include <sched.h>
 #include <semaphore.h>
+#include <stdatomic.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 // Spinlock
 typedef int spinlock_t;
@@ -15,16 +22,276 @@ static inline int atomic_xchg(volatile int *addr, int newval) {
   return result;
 }
 
+// Test-and-test-and-set spinlock with exponential backoff.
+//
+// The plain spin_lock() below executes a locked xchg on every iteration:
+// each waiter writes the lock's cache line, so the line bounces between
+// cores (and sockets) even though nobody can make progress. Here waiters
+// spin on a plain read, which keeps a shared copy of the line in every
+// waiter's cache, and only try the xchg once the lock looks free. A failed
+// try backs off for an exponentially growing (capped) number of `pause`s.
+// With SPIN_YIELD_AFTER > 0, a waiter calls sched_yield() after that many
+// rounds, which helps when there are more threads than cores.
+//
+// Build with -DSPIN_TTAS to make spin_lock() use this variant; the
+// spinlock_t type and SPIN_INIT() are unchanged.
+#ifndef SPIN_BACKOFF_MIN
+#define SPIN_BACKOFF_MIN 4
+#endif
+#ifndef SPIN_BACKOFF_MAX
+#define SPIN_BACKOFF_MAX 1024
+#endif
+#ifndef SPIN_YIELD_AFTER
+#define SPIN_YIELD_AFTER 0
+#endif
+
+static inline void cpu_relax() { asm volatile("pause" ::: "memory"); }
+
+void spin_lock_ttas(spinlock_t *lk) {
+  int backoff = SPIN_BACKOFF_MIN, rounds = 0;
+  while (1) {
+    // Test: wait with plain loads until the lock looks free.
+    while (*(volatile int *)lk != 0) {
+      cpu_relax();
+    }
+    // Test-and-set: only now write the cache line.
+    if (atomic_xchg(lk, 1) == 0) {
+      break;
+    }
+    for (int i = 0; i < backoff; i++) {
+      cpu_relax();
+    }
+    if (backoff < SPIN_BACKOFF_MAX) {
+      backoff <<= 1;
+    }
+    if (SPIN_YIELD_AFTER > 0 && ++rounds >= SPIN_YIELD_AFTER) {
+      sched_yield();
+      rounds = 0;
+    }
+  }
+}
+
 void spin_lock(spinlock_t *lk) {
+#ifdef SPIN_TTAS
+  spin_lock_ttas(lk);
+#else
   while (1) {
     intptr_t value = atomic_xchg(lk, 1);
     if (value == 0) {
       break;
     }
   }
+#endif
 }
 void spin_unlock(spinlock_t *lk) { atomic_xchg(lk, 0); }
 
+// Queue-based locks
+//
+// All spinlocks above are a single test-and-set word: every waiter spins
+// on the same cache line, and whoever wins the race gets the lock. The
+// locks below are FIFO-fair, and (MCS, CLH) each waiter spins on its own
+// cache line, so a release invalidates exactly one remote cache.
+//
+// They share one interface:
+//   xxx_lock_t lk = XXX_INIT();
+//   xxx_lock(&lk); ... xxx_unlock(&lk);
+// MCS and CLH queue nodes come from a small per-thread pool, so a thread
+// may hold up to QLOCK_NEST queue locks at a time, released in any order.
+#define QLOCK_NEST 8
+#define CACHELINE 64
+
+// Queue locks hand the lock to one specific waiter. If that waiter (or
+// the holder) is preempted, everybody behind it stalls until it runs
+// again; with more threads than cores, pure spinning may never let it
+// run. So unlike the spinlocks above, these spin loops yield by default,
+// after QLOCK_YIELD_AFTER rounds (SPIN_YIELD_AFTER, if set).
+#ifndef QLOCK_YIELD_AFTER
+#if SPIN_YIELD_AFTER > 0
+#define QLOCK_YIELD_AFTER SPIN_YIELD_AFTER
+#else
+#define QLOCK_YIELD_AFTER 128
+#endif
+#endif
+
+static inline void qlock_pause(int *rounds) {
+  cpu_relax();
+  if (QLOCK_YIELD_AFTER > 0 && ++*rounds >= QLOCK_YIELD_AFTER) {
+    sched_yield();
+    *rounds = 0;
+  }
+}
+
+static inline int qnode_alloc(unsigned *used) {
+  int i = __builtin_ctz(~*used);
+  assert(i < QLOCK_NEST);
+  *used |= 1u << i;
+  return i;
+}
+
+// Ticket lock: take a number, wait until it is served. Waiters still read
+// one shared word, but back off in proportion to their distance in line.
+typedef struct {
+  atomic_uint next;
+  _Alignas(CACHELINE) atomic_uint owner;
+} ticket_lock_t;
+#define TICKET_INIT() { 0 }
+
+void ticket_lock(ticket_lock_t *lk) {
+  unsigned me = atomic_fetch_add_explicit(&lk->next, 1, memory_order_relaxed);
+  int rounds = 0;
+  while (1) {
+    unsigned cur = atomic_load_explicit(&lk->owner, memory_order_acquire);
+    if (cur == me) {
+      break;
+    }
+    for (unsigned i = 0; i < (me - cur) * SPIN_BACKOFF_MIN; i++) {
+      cpu_relax();
+    }
+    // Far back in line: yield, the threads before us need the CPU more
+    if (QLOCK_YIELD_AFTER > 0 && me - cur > 1) sched_yield();
+    qlock_pause(&rounds);
+  }
+}
+void ticket_unlock(ticket_lock_t *lk) {
+  atomic_fetch_add_explicit(&lk->owner, 1, memory_order_release);
+}
+
+// MCS lock: waiters form a linked list; each spins on its own node until
+// its predecessor hands the lock over.
+struct mcs_node {
+  struct mcs_node *_Atomic next;
+  atomic_int locked;
+} __attribute__((aligned(CACHELINE)));
+
+typedef struct {
+  struct mcs_node *_Atomic tail;
+  struct mcs_node *holder;  // Written by the lock holder only
+} mcs_lock_t;
+#define MCS_INIT() { 0 }
+
+static __thread struct mcs_node mcs_nodes[QLOCK_NEST];
+static __thread unsigned mcs_used;
+
+void mcs_lock(mcs_lock_t *lk) {
+  struct mcs_node *me = &mcs_nodes[qnode_alloc(&mcs_used)];
+  atomic_store_explicit(&me->next, NULL, memory_order_relaxed);
+  atomic_store_explicit(&me->locked, 1, memory_order_relaxed);
+
+  struct mcs_node *pred =
+      atomic_exchange_explicit(&lk->tail, me, memory_order_acq_rel);
+  if (pred) {
+    int rounds = 0;
+    atomic_store_explicit(&pred->next, me, memory_order_release);
+    while (atomic_load_explicit(&me->locked, memory_order_acquire)) {
+      qlock_pause(&rounds);
+    }
+  }
+  lk->holder = me;
+}
+
+void mcs_unlock(mcs_lock_t *lk) {
+  struct mcs_node *me = lk->holder;
+  struct mcs_node *next = atomic_load_explicit(&me->next, memory_order_acquire);
+  if (!next) {
+    // No known successor: try to swing the tail back to empty.
+    struct mcs_node *expected = me;
+    if (atomic_compare_exchange_strong_explicit(
+            &lk->tail, &expected, NULL,
+            memory_order_release, memory_order_relaxed)) {
+      goto out;
+    }
+    // Someone enqueued behind us but has not linked itself yet.
+    int rounds = 0;
+    while (!(next = atomic_load_explicit(&me->next, memory_order_acquire))) {
+      qlock_pause(&rounds);
+    }
+  }
+  atomic_store_explicit(&next->locked, 0, memory_order_release);
+out:
+  mcs_used &= ~(1u << (me - mcs_nodes));
+}
+
+// CLH lock: an implicit queue; each waiter spins on its predecessor's
+// node. On release the node is handed to the successor and the thread
+// adopts its predecessor's node instead. Nodes therefore migrate between
+// threads and are never freed (one extra node per lock is allocated on
+// first use, like the intentional leak in lockdep).
+struct clh_node {
+  atomic_int locked;
+} __attribute__((aligned(CACHELINE)));
+
+typedef struct {
+  struct clh_node *_Atomic tail;
+  struct clh_node *holder, *pred;  // Written by the lock holder only
+  int slot;
+} clh_lock_t;
+#define CLH_INIT() { 0 }
+
+static __thread struct clh_node *clh_nodes[QLOCK_NEST];
+static __thread unsigned clh_used;
+
+void clh_lock(clh_lock_t *lk) {
+  int slot = qnode_alloc(&clh_used);
+  if (!clh_nodes[slot]) {
+    clh_nodes[slot] = aligned_alloc(CACHELINE, sizeof(struct clh_node));
+    assert(clh_nodes[slot]);
+  }
+  struct clh_node *me = clh_nodes[slot];
+  atomic_store_explicit(&me->locked, 1, memory_order_relaxed);
+
+  struct clh_node *pred =
+      atomic_exchange_explicit(&lk->tail, me, memory_order_acq_rel);
+  if (pred) {
+    int rounds = 0;
+    while (atomic_load_explicit(&pred->locked, memory_order_acquire)) {
+      qlock_pause(&rounds);
+    }
+  }
+  lk->holder = me;
+  lk->pred = pred;
+  lk->slot = slot;
+}
+
+void clh_unlock(clh_lock_t *lk) {
+  // Read our bookkeeping before the successor may overwrite it.
+  struct clh_node *me = lk->holder, *pred = lk->pred;
+  int slot = lk->slot;
+  atomic_store_explicit(&me->locked, 0, memory_order_release);
+  clh_nodes[slot] = pred;
+  clh_used &= ~(1u << slot);
+}
+
+// Futex mutex
+//
+// What pthread_mutex_t does underneath, in a dozen lines (Drepper,
+// "Futexes Are Tricky", mutex 2): 0 = unlocked, 1 = locked, 2 = locked
+// and somebody may be sleeping. Lock and unlock are a single atomic
+// instruction when uncontended; the kernel is entered only to sleep or to
+// wake a sleeper.
+typedef atomic_int futex_mutex_t;
+#define FUTEX_MUTEX_INIT() 0
+
+void futex_mutex_lock(futex_mutex_t *lk) {
+  int c = 0;
+  if (atomic_compare_exchange_strong(lk, &c, 1)) {
+    return;
+  }
+  if (c != 2) {
+    c = atomic_exchange(lk, 2);
+  }
+  while (c != 0) {
+    syscall(SYS_futex, lk, FUTEX_WAIT_PRIVATE, 2, NULL, NULL, 0);
+    c = atomic_exchange(lk, 2);
+  }
+}
+
+void futex_mutex_unlock(futex_mutex_t *lk) {
+  if (atomic_fetch_sub(lk, 1) != 1) {
+    atomic_store(lk, 0);
+    syscall(SYS_futex, lk, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+  }
+}
+
 // Mutex
 typedef pthread_mutex_t mutex_t;
 #define MUTEX_INIT() PTHREAD_MUTEX_INITIALIZER
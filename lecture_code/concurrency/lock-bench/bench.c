@@ -0,0 +1,239 @@
+#include "thread.h"
+#include "thread-sync.h"
+#include <getopt.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <x86intrin.h>
+
+// Lock scalability benchmark: the generalized 10_spin_scalability.c.
+//
+// Each thread repeatedly acquires a lock, increments a shared counter
+// `cs` times (the critical section), releases the lock, and then spins
+// for `think` iterations outside the lock. Every operation is timed with
+// rdtsc into a per-thread log-linear histogram, from which latency
+// percentiles are computed. One CSV line is printed per thread count.
+
+static long shared;
+static atomic_int start, stop;
+static int cs_len = 1, think = 0;
+
+// cmpxchg spinlock (sum-locked/sum.c)
+
+static void cmpxchg_lock(spinlock_t *lk) {
+  int expected;
+  do {
+    expected = 0;
+    asm volatile("lock cmpxchgl %2, %1"
+                 : "+a"(expected), "+m"(*lk)
+                 : "r"(1)
+                 : "memory", "cc");
+  } while (expected != 0);
+}
+
+// All locks behind one interface
+
+static spinlock_t spin = SPIN_INIT();
+static mutex_t mutex = MUTEX_INIT();
+static futex_mutex_t futex_mutex = FUTEX_MUTEX_INIT();
+static ticket_lock_t ticket = TICKET_INIT();
+static mcs_lock_t mcs = MCS_INIT();
+static clh_lock_t clh = CLH_INIT();
+
+static void xchg_acquire()     { spin_lock(&spin); }
+static void xchg_release()     { spin_unlock(&spin); }
+static void cmpxchg_acquire()  { cmpxchg_lock(&spin); }
+static void ttas_acquire()     { spin_lock_ttas(&spin); }
+static void mutex_acquire()    { mutex_lock(&mutex); }
+static void mutex_release()    { mutex_unlock(&mutex); }
+static void futex_acquire()    { futex_mutex_lock(&futex_mutex); }
+static void futex_release()    { futex_mutex_unlock(&futex_mutex); }
+static void ticket_acquire()   { ticket_lock(&ticket); }
+static void ticket_release()   { ticket_unlock(&ticket); }
+static void mcs_acquire()      { mcs_lock(&mcs); }
+static void mcs_release()      { mcs_unlock(&mcs); }
+static void clh_acquire()      { clh_lock(&clh); }
+static void clh_release()      { clh_unlock(&clh); }
+
+static struct lock_type {
+  const char *name;
+  void (*acquire)();
+  void (*release)();
+} lock_types[] = {
+  { "xchg",    xchg_acquire,    xchg_release },
+  { "cmpxchg", cmpxchg_acquire, xchg_release },
+  { "ttas",    ttas_acquire,    xchg_release },
+  { "mutex",   mutex_acquire,   mutex_release },
+  { "futex",   futex_acquire,   futex_release },
+  { "ticket",  ticket_acquire,  ticket_release },
+  { "mcs",     mcs_acquire,     mcs_release },
+  { "clh",     clh_acquire,     clh_release },
+  { "atomic",  NULL,            NULL },  // atomic_fetch_add, no lock
+};
+
+static struct lock_type *lock_type;
+
+// Log-linear latency histogram: values below 2^SUB are exact; above that,
+// each power of two is split into 2^SUB buckets (about 6% resolution).
+#define SUB 4
+#define NBUCKET (64 << SUB)
+
+struct hist {
+  long count[NBUCKET];
+  long ops;
+};
+
+static int bucket_of(unsigned long v) {
+  if (v < (1UL << SUB)) return v;
+  int msb = 63 - __builtin_clzl(v);
+  return ((msb - SUB + 1) << SUB) + ((v >> (msb - SUB)) & ((1 << SUB) - 1));
+}
+
+static unsigned long bucket_value(int b) {
+  if (b < (1 << SUB)) return b;
+  int msb = (b >> SUB) + SUB - 1;
+  return (1UL << msb) | ((unsigned long)(b & ((1 << SUB) - 1)) << (msb - SUB));
+}
+
+static struct hist total;
+static double finished;  // When the last thread saw 'stop'
+static pthread_mutex_t total_lk = PTHREAD_MUTEX_INITIALIZER;
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void Tbench(int id) {
+  struct hist *h = calloc(1, sizeof(struct hist));
+  assert(h);
+
+  while (!start) cpu_relax();
+  while (!stop) {
+    unsigned long t0 = __rdtsc();
+    if (lock_type->acquire) {
+      lock_type->acquire();
+      for (int i = 0; i < cs_len; i++) {
+        ((volatile long *)&shared)[0]++;
+      }
+      lock_type->release();
+    } else {
+      __atomic_fetch_add(&shared, 1, __ATOMIC_SEQ_CST);
+    }
+    unsigned long t1 = __rdtsc();
+    h->count[bucket_of(t1 - t0)]++;
+    h->ops++;
+
+    for (int i = 0; i < think; i++) {
+      asm volatile("" ::: "memory");
+    }
+  }
+  double done = now();
+
+  pthread_mutex_lock(&total_lk);
+  if (done > finished) finished = done;
+  for (int b = 0; b < NBUCKET; b++) total.count[b] += h->count[b];
+  total.ops += h->ops;
+  pthread_mutex_unlock(&total_lk);
+  free(h);
+}
+
+// TSC ticks per nanosecond
+static double tsc_per_ns() {
+  double t0 = now();
+  unsigned long c0 = __rdtsc();
+  usleep(100000);
+  return (__rdtsc() - c0) / ((now() - t0) * 1e9);
+}
+
+static double percentile(double p, double scale) {
+  long rank = (long)ceil(p * total.ops), seen = 0;
+  for (int b = 0; b < NBUCKET; b++) {
+    if ((seen += total.count[b]) >= rank && total.count[b]) {
+      return bucket_value(b) / scale;
+    }
+  }
+  return 0;
+}
+
+static double max_latency(double scale) {
+  for (int b = NBUCKET - 1; b >= 0; b--) {
+    if (total.count[b]) return bucket_value(b) / scale;
+  }
+  return 0;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+    "Usage: %s [-l lock] [-t threads,...] [-c cs] [-w think] [-d secs] [-p compact|scatter] [-n]\n"
+    "  -l  xchg cmpxchg ttas mutex futex ticket mcs clh atomic (default xchg)\n"
+    "  -t  thread counts to sweep, e.g. 1,2,4,8 (default 1,2,4)\n"
+    "  -c  shared-counter increments inside the lock (default 1)\n"
+    "  -w  loop iterations of think time outside the lock (default 0)\n"
+    "  -d  seconds per run (default 1)\n"
+    "  -p  pin threads (sets THREAD_PIN for thread.h)\n"
+    "  -n  no CSV header\n", prog);
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  char threads_def[] = "1,2,4";  // strtok() writes into it
+  char *threads_arg = threads_def;
+  double secs = 1;
+  int header = 1, opt;
+
+  lock_type = &lock_types[0];
+  while ((opt = getopt(argc, argv, "l:t:c:w:d:p:n")) != -1) {
+    switch (opt) {
+      case 'l':
+        lock_type = NULL;
+        for (int i = 0; i < sizeof(lock_types) / sizeof(lock_types[0]); i++) {
+          if (strcmp(optarg, lock_types[i].name) == 0) lock_type = &lock_types[i];
+        }
+        if (!lock_type) usage(argv[0]);
+        break;
+      case 't': threads_arg = optarg; break;
+      case 'c': cs_len = atoi(optarg); break;
+      case 'w': think = atoi(optarg); break;
+      case 'd': secs = atof(optarg); break;
+      case 'p': setenv("THREAD_PIN", optarg, 1); break;
+      case 'n': header = 0; break;
+      default: usage(argv[0]);
+    }
+  }
+
+  double scale = tsc_per_ns();
+  if (header) {
+    printf("lock,threads,cs,think,ops,ops_per_sec,p50_ns,p90_ns,p99_ns,p999_ns,max_ns\n");
+  }
+
+  for (char *tok = strtok(threads_arg, ","); tok; tok = strtok(NULL, ",")) {
+    int nthread = atoi(tok);
+    memset(&total, 0, sizeof(total));
+    finished = 0;
+    start = stop = 0;
+
+    for (int i = 0; i < nthread; i++) {
+      // Pin the i-th thread of every run to the same CPU.
+      struct thread_attr attr = thread_attr_policy(i);
+      create_ex(Tbench, &attr);
+    }
+    double t0 = now();
+    start = 1;
+    usleep(secs * 1e6);
+    stop = 1;
+    join();
+    // Up to the last operation, not including thread teardown in join()
+    double elapsed = finished - t0;
+
+    printf("%s,%d,%d,%d,%ld,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f\n",
+           lock_type->name, nthread, cs_len, think, total.ops,
+           total.ops / elapsed,
+           percentile(0.50, scale), percentile(0.90, scale),
+           percentile(0.99, scale), percentile(0.999, scale),
+           max_latency(scale));
+    fflush(stdout);
+  }
+  return 0;
+}
@@ -0,0 +1,249 @@
+#include "ring.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Producer/consumer throughput: the lock-free ring (include/ring.h)
+// against the designs of 11_producer_consumer.c (mutex + busy retry),
+// 13_single_condition_variable.c (one condition variable) and
+// 14_semaphore.c (two semaphores + mutex). Unlike the demos, every design
+// moves real items through an n-slot buffer. Output is CSV.
+
+static int n;
+static atomic_int stop;
+static atomic_long consumed;
+
+// A bounded FIFO for the lock-based designs (protected by their lock).
+static void **buf;
+static int head, count;
+
+static void buf_put(void *item) {
+  buf[(head + count++) % n] = item;
+}
+
+static void *buf_get() {
+  void *item = buf[head];
+  head = (head + 1) % n;
+  count--;
+  return item;
+}
+
+struct design {
+  const char *name;
+  void (*init)();
+  void (*put)(void *item);
+  void *(*get)();        // NULL: time to stop
+  void (*shutdown)(int np, int nc);
+  void (*fini)();
+};
+
+// Lock-free ring
+
+static ring_t ring;
+
+static void ring_b_init() { ring_init(&ring, n); }
+static void ring_b_put(void *item) { ring_push(&ring, item); }
+static void *ring_b_get() { return ring_pop(&ring); }
+static void ring_b_shutdown(int np, int nc) {
+  // Producers have exited; a NULL item stops each consumer.
+  for (int i = 0; i < nc; i++) ring_push(&ring, NULL);
+}
+static void ring_b_fini() { ring_destroy(&ring); }
+
+// 11_producer_consumer.c: mutex + busy retry
+
+static pthread_mutex_t lk = PTHREAD_MUTEX_INITIALIZER;
+
+static void retry_put(void *item) {
+  while (!stop) {
+    pthread_mutex_lock(&lk);
+    if (count < n) {
+      buf_put(item);
+      pthread_mutex_unlock(&lk);
+      return;
+    }
+    pthread_mutex_unlock(&lk);
+  }
+}
+
+static void *retry_get() {
+  while (!stop) {
+    pthread_mutex_lock(&lk);
+    if (count > 0) {
+      void *item = buf_get();
+      pthread_mutex_unlock(&lk);
+      return item;
+    }
+    pthread_mutex_unlock(&lk);
+  }
+  return NULL;
+}
+
+// 13_single_condition_variable.c: one condition variable, signal()
+// (may deadlock; the run then simply stops making progress)
+
+static pthread_cond_t cv = PTHREAD_COND_INITIALIZER;
+
+static void cv_put(void *item) {
+  pthread_mutex_lock(&lk);
+  while (count == n && !stop) {
+    pthread_cond_wait(&cv, &lk);
+  }
+  if (!stop) {
+    buf_put(item);
+    pthread_cond_signal(&cv);
+  }
+  pthread_mutex_unlock(&lk);
+}
+
+static void *cv_get() {
+  void *item = NULL;
+  pthread_mutex_lock(&lk);
+  while (count == 0 && !stop) {
+    pthread_cond_wait(&cv, &lk);
+  }
+  if (!stop) {
+    item = buf_get();
+    pthread_cond_signal(&cv);
+  }
+  pthread_mutex_unlock(&lk);
+  return item;
+}
+
+static void cv_shutdown(int np, int nc) {
+  pthread_mutex_lock(&lk);
+  pthread_cond_broadcast(&cv);
+  pthread_mutex_unlock(&lk);
+}
+
+// 14_semaphore.c: two semaphores + mutex
+
+static sem_t empty_sem, full_sem;
+
+static void sem_b_init() {
+  sem_init(&empty_sem, 0, n);
+  sem_init(&full_sem, 0, 0);
+}
+
+static void sem_b_put(void *item) {
+  sem_wait(&empty_sem);
+  if (stop) return;
+  pthread_mutex_lock(&lk);
+  buf_put(item);
+  pthread_mutex_unlock(&lk);
+  sem_post(&full_sem);
+}
+
+static void *sem_b_get() {
+  sem_wait(&full_sem);
+  if (stop) return NULL;
+  pthread_mutex_lock(&lk);
+  void *item = buf_get();
+  pthread_mutex_unlock(&lk);
+  sem_post(&empty_sem);
+  return item;
+}
+
+static void sem_b_shutdown(int np, int nc) {
+  for (int i = 0; i < np; i++) sem_post(&empty_sem);
+  for (int i = 0; i < nc; i++) sem_post(&full_sem);
+}
+
+static void sem_b_fini() {
+  sem_destroy(&empty_sem);
+  sem_destroy(&full_sem);
+}
+
+static void noop() {}
+static void noop_shutdown(int np, int nc) {}
+
+static struct design designs[] = {
+  { "ring",        ring_b_init, ring_b_put, ring_b_get, ring_b_shutdown, ring_b_fini },
+  { "mutex-retry", noop,        retry_put,  retry_get,  noop_shutdown,   noop },
+  { "single-cv",   noop,        cv_put,     cv_get,     cv_shutdown,     noop },
+  { "semaphore",   sem_b_init,  sem_b_put,  sem_b_get,  sem_b_shutdown,  sem_b_fini },
+};
+
+static struct design *cur;
+
+static void *Tproduce(void *arg) {
+  for (uintptr_t i = 1; !stop; i++) {
+    cur->put((void *)i);  // Items are never NULL
+  }
+  return NULL;
+}
+
+static void *Tconsume(void *arg) {
+  long local = 0;
+  while (cur->get()) {
+    local++;
+  }
+  atomic_fetch_add(&consumed, local);
+  return NULL;
+}
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double run(struct design *d, int nbuf, int nthread, double secs) {
+  pthread_t producers[nthread], consumers[nthread];
+
+  cur = d;
+  n = nbuf;
+  head = count = 0;
+  stop = 0;
+  consumed = 0;
+  buf = calloc(n, sizeof(void *));
+  d->init();
+
+  double t0 = now();
+  for (int i = 0; i < nthread; i++) {
+    pthread_create(&producers[i], NULL, Tproduce, NULL);
+    pthread_create(&consumers[i], NULL, Tconsume, NULL);
+  }
+  usleep(secs * 1e6);
+  stop = 1;
+
+  if (d == &designs[0]) {
+    // The ring's consumers must keep draining until the producers are out.
+    for (int i = 0; i < nthread; i++) pthread_join(producers[i], NULL);
+    d->shutdown(nthread, nthread);
+  } else {
+    d->shutdown(nthread, nthread);
+    for (int i = 0; i < nthread; i++) pthread_join(producers[i], NULL);
+  }
+  for (int i = 0; i < nthread; i++) pthread_join(consumers[i], NULL);
+  // Items drained after 'stop' are counted, so the time they took must be too
+  double elapsed = now() - t0;
+
+  d->fini();
+  free(buf);
+  return consumed / elapsed;
+}
+
+// Usage: ./bench [seconds per run] [design]
+int main(int argc, char *argv[]) {
+  double secs = argc > 1 ? atof(argv[1]) : 0.2;
+  const char *only = argc > 2 ? argv[2] : NULL;
+  int sizes[] = { 1, 8, 64, 1024 };
+  int nthreads[] = { 1, 2, 4, 8 };
+
+  printf("design,buffer,producers,consumers,items_per_sec\n");
+  for (int i = 0; i < sizeof(designs) / sizeof(designs[0]); i++) {
+    if (only && strcmp(only, designs[i].name) != 0) continue;
+    for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+      for (int t = 0; t < sizeof(nthreads) / sizeof(nthreads[0]); t++) {
+        double rate = run(&designs[i], sizes[s], nthreads[t], secs);
+        printf("%s,%d,%d,%d,%.0f\n", designs[i].name, sizes[s],
+               nthreads[t], nthreads[t], rate);
+        fflush(stdout);
+      }
+    }
+  }
+  return 0;
+}
@@ -1,11 +1,18 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE  // CPU_SET(), pthread_attr_setaffinity_np()
+#endif
 #include <assert.h>
+#include <dirent.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
-#define NTHREAD 6400
 enum {
   T_FREE = 0,
   T_LIVE,
@@ -15,40 +22,560 @@ struct thread {
   int id, status;
   pthread_t thread;
   void (*entry)(int);
+  void *stack;         // Stack mapped by create_ex(), if any
+  size_t stack_size;
+  int slot;            // Index in threads.live[]
+  int claimed;         // A join_one() is waiting for it
+  struct thread *next; // Link in threads.dead
 };
 
-struct thread tpool[NTHREAD], *tptr = tpool;
+// Only threads that have not been joined yet are tracked: live[] is a
+// compact, growable array (removal swaps in the last entry), and threads
+// whose entry function has returned (or that called pthread_exit()) are
+// also queued on the dead list. join(), join_one() and join_any()
+// therefore cost O(live threads), no matter how many threads the program
+// has created over its lifetime.
+static struct {
+  pthread_mutex_t lk;
+  pthread_cond_t exited;
+  struct thread **live, *dead;
+  int nlive, nclaimed, capacity, nextid;
+} threads = {
+  .lk = PTHREAD_MUTEX_INITIALIZER,
+  .exited = PTHREAD_COND_INITIALIZER,
+};
+
+// Runs when the entry function returns, and also when the thread ends
+// with pthread_exit() (a cleanup handler), so join() never waits forever.
+static void thread_exited(void *arg) {
+  struct thread *thread = (struct thread *)arg;
+  pthread_mutex_lock(&threads.lk);
+  thread->status = T_DEAD;
+  thread->next = threads.dead;
+  threads.dead = thread;
+  pthread_cond_broadcast(&threads.exited);
+  pthread_mutex_unlock(&threads.lk);
+}
 
 void *wrapper(void *arg) {
   struct thread *thread = (struct thread *)arg;
+  pthread_cleanup_push(thread_exited, thread);
   thread->entry(thread->id);
+  pthread_cleanup_pop(1);
   return NULL;
 }
 
-void create(void *fn) {
-  // pthread_attr_t attr;
-  // pthread_attr_init(&attr);
-  // pthread_attr_setstacksize(&attr, 1024 * 1024);
-  assert(tptr - tpool < NTHREAD);
-  *tptr = (struct thread){
-      .id = tptr - tpool + 1,
+// Thread placement
+//
+// struct thread_attr controls where a thread runs and where its stack
+// lives. With numa_local set, create_ex() maps the stack itself and binds
+// it to the NUMA node of `cpu`; glibc carves the thread's TCB and static
+// TLS out of the top of a user-supplied stack, so they become node-local
+// too. create() takes its attributes from the environment:
+//
+//   THREAD_PIN=compact   pin thread k to the k-th CPU, filling one node first
+//   THREAD_PIN=scatter   pin thread k round-robin across NUMA nodes
+//   THREAD_STACK=256K    stack size (K/M/G suffixes)
+//   THREAD_NUMA=0|1      NUMA-local stacks (default: on if pinned and the
+//                        machine has more than one node)
+//
+// e.g. THREAD_PIN=scatter ./a.out 16 makes benchmarks reproducible.
+struct thread_attr {
+  size_t stack_size;  // 0: pthread default
+  int cpu;            // -1: not pinned
+  int numa_local;     // Allocate the stack on cpu's node
+};
+#define THREAD_ATTR_DEFAULT ((struct thread_attr){ .cpu = -1 })
+
+enum {
+  PIN_NONE = 0,
+  PIN_COMPACT,
+  PIN_SCATTER,
+};
+
+static struct {
+  pthread_once_t once;
+  int pin, numa, ncpu, nnode;
+  size_t stack_size;
+  int order[CPU_SETSIZE];  // Allowed CPUs in placement order
+  int node[CPU_SETSIZE];   // NUMA node of each CPU
+} placement = {
+  .once = PTHREAD_ONCE_INIT,
+};
+
+static size_t parse_size(const char *s) {
+  char *end;
+  size_t n = strtoull(s, &end, 0);
+  switch (*end) {
+    case 'G': case 'g': n <<= 10; // fall through
+    case 'M': case 'm': n <<= 10; // fall through
+    case 'K': case 'k': n <<= 10;
+  }
+  return n;
+}
+
+static void placement_init() {
+  const char *pin = getenv("THREAD_PIN"), *numa = getenv("THREAD_NUMA"),
+             *stack = getenv("THREAD_STACK");
+  if (pin && strcmp(pin, "compact") == 0) placement.pin = PIN_COMPACT;
+  if (pin && strcmp(pin, "scatter") == 0) placement.pin = PIN_SCATTER;
+  if (stack) placement.stack_size = parse_size(stack);
+
+  // NUMA topology from sysfs; a machine without it is a single node.
+  DIR *dir = opendir("/sys/devices/system/node");
+  struct dirent *d;
+  while (dir && (d = readdir(dir))) {
+    int nid, lo, hi;
+    char path[300];
+    if (sscanf(d->d_name, "node%d", &nid) != 1) continue;
+    snprintf(path, sizeof(path), "/sys/devices/system/node/%s/cpulist",
+             d->d_name);
+    FILE *fp = fopen(path, "r");
+    if (!fp) continue;
+    while (fscanf(fp, "%d", &lo) == 1) {
+      hi = lo;
+      if (fscanf(fp, "-%d", &hi) != 1) hi = lo;
+      for (int c = lo; c <= hi && c < CPU_SETSIZE; c++) placement.node[c] = nid;
+      if (fgetc(fp) != ',') break;
+    }
+    fclose(fp);
+    if (nid + 1 > placement.nnode) placement.nnode = nid + 1;
+  }
+  if (dir) closedir(dir);
+  if (placement.nnode == 0) placement.nnode = 1;
+
+  cpu_set_t allowed;
+  int rc = sched_getaffinity(0, sizeof(allowed), &allowed);
+  assert(rc == 0);
+  (void)rc;  // Unused with -DNDEBUG
+  if (placement.pin == PIN_SCATTER) {
+    // Take one CPU from each node in turn.
+    int remaining = CPU_COUNT(&allowed);
+    while (remaining > 0) {
+      for (int n = 0; n < placement.nnode; n++) {
+        for (int c = 0; c < CPU_SETSIZE; c++) {
+          if (CPU_ISSET(c, &allowed) && placement.node[c] == n) {
+            placement.order[placement.ncpu++] = c;
+            CPU_CLR(c, &allowed);
+            remaining--;
+            break;
+          }
+        }
+      }
+    }
+  } else {
+    for (int n = 0; n < placement.nnode; n++) {
+      for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, &allowed) && placement.node[c] == n) {
+          placement.order[placement.ncpu++] = c;
+        }
+      }
+    }
+  }
+
+  placement.numa = numa ? atoi(numa)
+                        : placement.pin != PIN_NONE && placement.nnode > 1;
+}
+
+// Attributes the environment asks for, for the k-th thread (k >= 0).
+struct thread_attr thread_attr_policy(int k) {
+  pthread_once(&placement.once, placement_init);
+  struct thread_attr attr = THREAD_ATTR_DEFAULT;
+  attr.stack_size = placement.stack_size;
+  if (placement.pin != PIN_NONE && placement.ncpu > 0) {
+    attr.cpu = placement.order[k % placement.ncpu];
+    attr.numa_local = placement.numa;
+  }
+  return attr;
+}
+
+// Fill in a pthread_attr_t; returns the stack it mapped (or NULL).
+static void *thread_attr_setup(pthread_attr_t *pa,
+                               const struct thread_attr *attr,
+                               size_t *stack_size) {
+  void *stack = NULL;
+  pthread_attr_init(pa);
+
+  if (attr->cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(attr->cpu, &set);
+    pthread_attr_setaffinity_np(pa, sizeof(set), &set);
+  }
+
+  size_t size = attr->stack_size;
+  if (attr->numa_local && attr->cpu >= 0) {
+    if (size == 0) {
+      pthread_attr_getstacksize(pa, &size);
+    }
+    long pgsz = sysconf(_SC_PAGESIZE);
+    size = (size + pgsz - 1) & ~(pgsz - 1);
+    stack = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE,
+                 -1, 0);
+    assert(stack != MAP_FAILED);
+    mprotect(stack, pgsz, PROT_NONE);  // Guard page
+
+    // mbind(MPOL_PREFERRED): fault pages in on the target node. The
+    // raw syscall avoids a dependency on libnuma.
+    int node = placement.node[attr->cpu];
+    if (node >= 0 && node < 64) {  // One word of node mask
+      unsigned long mask = 1UL << node;
+      syscall(SYS_mbind, stack, size, 1 /* MPOL_PREFERRED */, &mask,
+              sizeof(mask) * 8, 0);
+    }
+    pthread_attr_setstack(pa, stack, size);
+    *stack_size = size;
+  } else if (size > 0) {
+    pthread_attr_setstacksize(pa, size);
+  }
+  return stack;
+}
+
+// Returns the new thread's id (1, 2, 3, ...), which is passed to fn.
+int create_ex(void *fn, const struct thread_attr *attr) {
+  struct thread *t = malloc(sizeof(struct thread));
+  assert(t);
+
+  pthread_mutex_lock(&threads.lk);
+  if (threads.nlive == threads.capacity) {
+    threads.capacity = threads.capacity ? threads.capacity * 2 : 16;
+    threads.live = realloc(threads.live,
+                           threads.capacity * sizeof(struct thread *));
+    assert(threads.live);
+  }
+  *t = (struct thread){
+      .id = ++threads.nextid,
       .status = T_LIVE,
       .entry = fn,
+      .slot = threads.nlive,
   };
-  pthread_create(&(tptr->thread), NULL, wrapper, tptr);
-  // pthread_create(&(tptr->thread), &attr, wrapper, tptr);
-  // pthread_attr_destroy(&attr);
-  ++tptr;
+  threads.live[threads.nlive++] = t;
+
+  struct thread_attr policy;
+  if (!attr) {
+    policy = thread_attr_policy(t->id - 1);
+    attr = &policy;
+  }
+  pthread_attr_t pa;
+  t->stack = thread_attr_setup(&pa, attr, &t->stack_size);
+  int rc = pthread_create(&(t->thread), &pa, wrapper, t);
+  assert(rc == 0);
+  (void)rc;  // Unused with -DNDEBUG
+  pthread_attr_destroy(&pa);
+  pthread_mutex_unlock(&threads.lk);
+  return t->id;
 }
 
-void join() {
-  for (int i = 0; i < NTHREAD; i++) {
-    struct thread *t = &tpool[i];
-    if (t->status == T_LIVE) {
-      pthread_join(t->thread, NULL);
-      t->status = T_DEAD;
+int create(void *fn) { return create_ex(fn, NULL); }
+
+// Both called with threads.lk held.
+static void thread_untrack(struct thread *t) {
+  struct thread *last = threads.live[--threads.nlive];
+  threads.live[t->slot] = last;
+  last->slot = t->slot;
+
+  for (struct thread **p = &threads.dead; *p; p = &(*p)->next) {
+    if (*p == t) {
+      *p = t->next;
+      break;
     }
   }
 }
 
+static int thread_reap(struct thread *t) {
+  int id = t->id;
+  pthread_join(t->thread, NULL);
+  if (t->stack) {
+    munmap(t->stack, t->stack_size);
+  }
+  free(t);
+  return id;
+}
+
+// Wait for any thread to exit, reap it and return its id;
+// returns 0 if there are no live threads.
+int join_any() {
+  struct thread *t = NULL;
+  pthread_mutex_lock(&threads.lk);
+  while (!t) {
+    if (threads.nlive - threads.nclaimed == 0) {
+      pthread_mutex_unlock(&threads.lk);
+      return 0;
+    }
+    for (t = threads.dead; t && t->claimed; t = t->next)
+      ;
+    if (!t) {
+      pthread_cond_wait(&threads.exited, &threads.lk);
+    }
+  }
+  thread_untrack(t);
+  pthread_mutex_unlock(&threads.lk);
+  return thread_reap(t);
+}
+
+// Wait for thread `id` to exit and reap it; returns -1 if `id` is not a
+// live thread (never created, already joined, or being joined).
+int join_one(int id) {
+  pthread_mutex_lock(&threads.lk);
+  struct thread *t = NULL;
+  for (int i = 0; i < threads.nlive; i++) {
+    if (threads.live[i]->id == id && !threads.live[i]->claimed) {
+      t = threads.live[i];
+      break;
+    }
+  }
+  if (!t) {
+    pthread_mutex_unlock(&threads.lk);
+    return -1;
+  }
+  t->claimed = 1;
+  threads.nclaimed++;
+  while (t->status != T_DEAD) {
+    pthread_cond_wait(&threads.exited, &threads.lk);
+  }
+  threads.nclaimed--;
+  thread_untrack(t);
+  pthread_mutex_unlock(&threads.lk);
+  return thread_reap(t);
+}
+
+void join() {
+  while (join_any() > 0)
+    ;
+}
+
 __attribute__((destructor)) void cleanup() { join(); }
+
+// Task pool
+//
+// create() starts one OS thread per call, which is far too expensive for
+// fine-grained work. task_spawn() instead queues fn(arg) on a fixed pool
+// of workers (one per online CPU, started on first use). Each worker owns
+// a Chase-Lev deque: it pushes and pops its own tasks at the bottom (LIFO,
+// cache-warm), while idle workers steal from the top of random victims.
+// Tasks spawned from outside the pool go to a shared injection queue.
+// task_join() waits until every spawned task has finished; it must not be
+// called from inside a task. The pool's workers are detached and never
+// counted by join().
+#define NWORKER_MAX 256
+
+struct task {
+  void (*fn)(void *);
+  void *arg;
+  struct task *next;  // Injection queue link
+};
+
+struct ws_array {
+  long size;
+  struct task *_Atomic buf[];
+};
+
+struct ws_deque {
+  _Atomic long top;
+  _Alignas(64) _Atomic long bottom;
+  struct ws_array *_Atomic array;
+} __attribute__((aligned(64)));
+
+static struct {
+  int nworker;
+  struct ws_deque deques[NWORKER_MAX];
+  pthread_once_t once;
+  pthread_mutex_t lk;
+  pthread_cond_t work, idle;
+  struct task *_Atomic inject_head, *inject_tail;
+  atomic_long queued;       // Spawned, not yet picked up by a worker
+  atomic_long outstanding;  // Spawned, not yet finished
+  atomic_int sleepers;
+} pool = {
+  .once = PTHREAD_ONCE_INIT,
+  .lk = PTHREAD_MUTEX_INITIALIZER,
+  .work = PTHREAD_COND_INITIALIZER,
+  .idle = PTHREAD_COND_INITIALIZER,
+};
+
+static __thread int worker_id = -1;
+
+static struct ws_array *ws_array_new(long size) {
+  struct ws_array *a = malloc(sizeof(*a) + size * sizeof(a->buf[0]));
+  assert(a);
+  a->size = size;
+  return a;
+}
+
+// Owner only. Old arrays are leaked on purpose: a concurrent thief may
+// still be reading from them.
+static void ws_push(struct ws_deque *d, struct task *t) {
+  long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+  long top = atomic_load_explicit(&d->top, memory_order_acquire);
+  struct ws_array *a = atomic_load_explicit(&d->array, memory_order_relaxed);
+  if (b - top > a->size - 1) {
+    struct ws_array *bigger = ws_array_new(a->size * 2);
+    for (long i = top; i < b; i++) {
+      atomic_store_explicit(&bigger->buf[i % bigger->size],
+          atomic_load_explicit(&a->buf[i % a->size], memory_order_relaxed),
+          memory_order_relaxed);
+    }
+    atomic_store_explicit(&d->array, bigger, memory_order_release);
+    a = bigger;
+  }
+  atomic_store_explicit(&a->buf[b % a->size], t, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+}
+
+// Owner only.
+static struct task *ws_take(struct ws_deque *d) {
+  long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+  struct ws_array *a = atomic_load_explicit(&d->array, memory_order_relaxed);
+  atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  long top = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+  struct task *t = NULL;
+  if (top <= b) {
+    t = atomic_load_explicit(&a->buf[b % a->size], memory_order_relaxed);
+    if (top == b) {
+      // Last element: race against thieves for it.
+      if (!atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1,
+              memory_order_seq_cst, memory_order_relaxed)) {
+        t = NULL;
+      }
+      atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+  } else {
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+  }
+  return t;
+}
+
+// Any thread.
+static struct task *ws_steal(struct ws_deque *d) {
+  long top = atomic_load_explicit(&d->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+  if (top < b) {
+    struct ws_array *a = atomic_load_explicit(&d->array, memory_order_acquire);
+    struct task *t = atomic_load_explicit(&a->buf[top % a->size],
+                                          memory_order_relaxed);
+    if (atomic_compare_exchange_strong_explicit(&d->top, &top, top + 1,
+            memory_order_seq_cst, memory_order_relaxed)) {
+      return t;
+    }
+  }
+  return NULL;
+}
+
+static struct task *pool_find_task(unsigned *seed) {
+  struct task *t = NULL;
+  if (worker_id >= 0) {
+    t = ws_take(&pool.deques[worker_id]);
+  }
+  if (!t && pool.inject_head) {
+    pthread_mutex_lock(&pool.lk);
+    if ((t = pool.inject_head)) {
+      pool.inject_head = t->next;
+    }
+    pthread_mutex_unlock(&pool.lk);
+  }
+  for (int i = 0; !t && i < pool.nworker; i++) {
+    int victim = rand_r(seed) % pool.nworker;
+    if (victim != worker_id) {
+      t = ws_steal(&pool.deques[victim]);
+    }
+  }
+  if (t) {
+    atomic_fetch_sub(&pool.queued, 1);
+  }
+  return t;
+}
+
+static void *pool_worker(void *arg) {
+  worker_id = (int)(intptr_t)arg;
+  unsigned seed = worker_id + 1;
+  while (1) {
+    struct task *t = pool_find_task(&seed);
+    if (!t) {
+      if (atomic_load(&pool.queued) > 0) {
+        continue;  // Someone is about to publish a task
+      }
+      pthread_mutex_lock(&pool.lk);
+      atomic_fetch_add(&pool.sleepers, 1);
+      while (atomic_load(&pool.queued) == 0) {
+        pthread_cond_wait(&pool.work, &pool.lk);
+      }
+      atomic_fetch_sub(&pool.sleepers, 1);
+      pthread_mutex_unlock(&pool.lk);
+      continue;
+    }
+
+    t->fn(t->arg);
+    free(t);
+
+    if (atomic_fetch_sub(&pool.outstanding, 1) == 1) {
+      pthread_mutex_lock(&pool.lk);
+      pthread_cond_broadcast(&pool.idle);
+      pthread_mutex_unlock(&pool.lk);
+    }
+  }
+  return NULL;
+}
+
+static void pool_start() {
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  pool.nworker = ncpu < 1 ? 1 : ncpu > NWORKER_MAX ? NWORKER_MAX : ncpu;
+  for (int i = 0; i < pool.nworker; i++) {
+    atomic_store(&pool.deques[i].array, ws_array_new(256));
+  }
+  for (int i = 0; i < pool.nworker; i++) {
+    // Workers follow the same THREAD_PIN/THREAD_STACK policy as create().
+    struct thread_attr attr = thread_attr_policy(i);
+    pthread_attr_t pa;
+    size_t stack_size;
+    pthread_t pt;
+    thread_attr_setup(&pa, &attr, &stack_size);
+    int rc = pthread_create(&pt, &pa, pool_worker, (void *)(intptr_t)i);
+    assert(rc == 0);
+    (void)rc;  // Unused with -DNDEBUG
+    pthread_attr_destroy(&pa);
+    pthread_detach(pt);
+  }
+}
+
+void task_spawn(void (*fn)(void *), void *arg) {
+  pthread_once(&pool.once, pool_start);
+
+  struct task *t = malloc(sizeof(struct task));
+  assert(t);
+  *t = (struct task){ .fn = fn, .arg = arg };
+
+  atomic_fetch_add(&pool.outstanding, 1);
+  atomic_fetch_add(&pool.queued, 1);
+  if (worker_id >= 0) {
+    ws_push(&pool.deques[worker_id], t);
+  } else {
+    pthread_mutex_lock(&pool.lk);
+    if (pool.inject_head) {
+      pool.inject_tail->next = t;
+    } else {
+      pool.inject_head = t;
+    }
+    pool.inject_tail = t;
+    pthread_mutex_unlock(&pool.lk);
+  }
+
+  if (atomic_load(&pool.sleepers) > 0) {
+    pthread_mutex_lock(&pool.lk);
+    pthread_cond_signal(&pool.work);
+    pthread_mutex_unlock(&pool.lk);
+  }
+}
+
+void task_join() {
+  assert(worker_id < 0);
+  pthread_mutex_lock(&pool.lk);
+  while (atomic_load(&pool.outstanding) > 0) {
+    pthread_cond_wait(&pool.idle, &pool.lk);
+  }
+  pthread_mutex_unlock(&pool.lk);
+}
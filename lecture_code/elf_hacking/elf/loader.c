@@ -4,91 +4,567 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <assert.h>
+#include <errno.h>
+#include <stdarg.h>
 #include <elf.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <sys/auxv.h>
 #include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+// What the initial process stack and the jump to user code need to know
+// about a loaded ELF image.
+struct image {
+    uintptr_t bias;   // Load bias: 0 for ET_EXEC, the mapping's base for ET_DYN
+    uintptr_t entry;  // e_entry + bias
+    uintptr_t phdr;   // Program header table in memory (AT_PHDR)
+    int phnum;
+    int exec_stack;   // PT_GNU_STACK asks for an executable stack
+    char *interp;     // PT_INTERP: the dynamic linker to load (or NULL)
+};
 
 void my_execve(const char *file, char *argv[], char *envp[]);
-void *init_proc_stack(char *argv[], char *envp[]);
+void load_image(const char *file, uintptr_t base, struct image *img);
+void *init_proc_stack(const char *file, char *argv[], char *envp[],
+                      struct image *img, uintptr_t interp_base);
+
+static uintptr_t page;       // Page size
+static uintptr_t load_base;  // -b: where to load a PIE (0: anywhere)
+static const char *cache_dir;  // -c: directory of prelinked images (NULL: none)
+
+#define PAGE_DOWN(x) ((uintptr_t)(x) & ~(page - 1))
+#define PAGE_UP(x)   PAGE_DOWN((uintptr_t)(x) + page - 1)
+
+static void die(const char *file, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "loader: %s: ", file);
+    vfprintf(stderr, fmt, ap);
+    fprintf(stderr, "\n");
+    va_end(ap);
+    exit(1);
+}
 
 int main(int argc, char *argv[], char *envp[]) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s file [args...]\n", argv[0]);
+    int opt;
+    // '+': stop at the file name, the rest are the program's arguments
+    while ((opt = getopt(argc, argv, "+b:c:")) != -1) {
+        switch (opt) {
+            case 'b': load_base = strtoul(optarg, NULL, 0); break;
+            case 'c': cache_dir = optarg; break;
+            default: optind = argc;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "Usage: %s [-b base] [-c cache-dir] file [args...]\n", argv[0]);
         exit(1);
     }
 
-    my_execve(argv[1], argv + 1, envp);
+    page = sysconf(_SC_PAGESIZE);
+    if (load_base & (page - 1)) {
+        fprintf(stderr, "loader: -b %#lx is not page-aligned\n", load_base);
+        exit(1);
+    }
+    if (cache_dir) mkdir(cache_dir, 0700);  // May exist already
+    my_execve(argv[optind], argv + optind, envp);
 }
 
 void my_execve(const char *file, char *argv[], char *envp[]) {
-    // WARNING: This execve leaks memory and ignores
-    // error checing for brevity.
+    // WARNING: This execve leaks memory: the loader's own mappings
+    // (code, heap, stack) stay in the address space.
+
+    struct image img, interp;
+    load_image(file, load_base, &img);
+
+    // A dynamically linked program starts in its dynamic linker (ld.so),
+    // as with the kernel's execve: ld.so finds the program through auxv
+    // (AT_PHDR, AT_ENTRY), loads its libraries, relocates everything and
+    // jumps to AT_ENTRY. AT_BASE tells ld.so where it was loaded itself.
+    uintptr_t entry = img.entry, interp_base = 0;
+    if (img.interp) {
+        load_image(img.interp, 0, &interp);
+        if (interp.interp) die(img.interp, "the dynamic linker has PT_INTERP itself");
+        entry = interp.entry;
+        interp_base = interp.bias;
+        img.exec_stack |= interp.exec_stack;
+    }
+
+    void *rsp = init_proc_stack(file, argv, envp, &img, interp_base);
+    asm volatile(
+        "mov $0, %%rdx;" // required by System-V ABI
+        "mov %0, %%rsp;" // loader allocated
+        "jmp *%1" : : "a"(rsp), "b"(entry)
+    );
+}
+
+static int prot_of(const Elf64_Phdr *p) {
+    int prot = 0;
+    if (p->p_flags & PF_R) prot |= PROT_READ;
+    if (p->p_flags & PF_W) prot |= PROT_WRITE;
+    if (p->p_flags & PF_X) prot |= PROT_EXEC;
+    return prot;
+}
+
+// Map one PT_LOAD segment at p_vaddr + bias. mmap() works on whole pages,
+// so the mapping starts at the page holding p_vaddr; p_offset has the same
+// offset within its page (checked by the caller).
+static void load_segment(const char *file, int fd, const Elf64_Phdr *p, uintptr_t bias) {
+    int prot = prot_of(p);
+    uintptr_t start = bias + p->p_vaddr, off = start & (page - 1);
+    uintptr_t file_end = start + p->p_filesz, mem_end = start + p->p_memsz;
+    uintptr_t zero_beg = PAGE_DOWN(start);  // First page not backed by the file
 
-    int fd = open(file, O_RDONLY);
-    assert(fd > 0);
+    // Map file contents
+    if (p->p_filesz > 0) {
+        void *ret = mmap(
+            (void *)(start - off),          // addr, rounded to a page
+            p->p_filesz + off,              // length, from that page
+            prot,                           // protection
+            MAP_PRIVATE | MAP_FIXED,        // flags, private & strict
+            fd, p->p_offset - off           // file and offset
+        );
+        if (ret == MAP_FAILED) {
+            die(file, "cannot map segment at %#lx: %s", start, strerror(errno));
+        }
+        zero_beg = PAGE_UP(file_end);
+    }
 
-    // Map ELF header to memory
-    Elf64_Ehdr *h = mmap(NULL, 4096, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p->p_memsz <= p->p_filesz) return;
 
-    #define ROUND(x, align) (((uintptr_t)x) & ~(align - 1))
+    // bss: the last file page holds whatever follows the segment in the
+    // file, so clear its tail (making it writable for a moment if needed).
+    // Clear it up to the page end, as the kernel does: ld.so's early
+    // malloc() hands out the rest of that page as zeroed memory...
+    if (file_end < zero_beg) {
+        if (!(prot & PROT_WRITE)) {
+            mprotect((void *)PAGE_DOWN(file_end), page, prot | PROT_WRITE);
+        }
+        memset((void *)file_end, 0, zero_beg - file_end);
+        if (!(prot & PROT_WRITE)) {
+            mprotect((void *)PAGE_DOWN(file_end), page, prot);
+        }
+    }
+
+    // ...and map anonymous (zero) memory for the pages after it.
+    if (PAGE_UP(mem_end) > zero_beg) {
+        void *ret = mmap(
+            (void *)zero_beg,                        // addr
+            PAGE_UP(mem_end) - zero_beg,             // length
+            prot,                                    // protection
+            MAP_ANONYMOUS | MAP_PRIVATE | MAP_FIXED, // flags
+            -1, 0                                    // no file and offset
+        );
+        if (ret == MAP_FAILED) {
+            die(file, "cannot map bss at %#lx: %s", zero_beg, strerror(errno));
+        }
+    }
+}
+
+static int power_of_two(uint64_t x) {
+    return x && !(x & (x - 1));
+}
+
+// Prelinked image cache (-c)
+//
+// Once an image has been loaded, its memory is saved to the cache
+// directory exactly as laid out: every PT_LOAD segment at its final
+// address, bss cleared, and a header with what struct image holds. The
+// cache file is named after the ELF file's device, inode, size and mtime,
+// so a rebuilt or replaced file is never mistaken for its old image.
+// Loading a cached image then takes one mmap() of the whole range, at the
+// same address as before, plus an mprotect() per segment. A PIE thus
+// keeps the load bias it first got (no more ASLR); if that range is taken,
+// the file is loaded from scratch (and cached again).
+//
+// Relocations are still applied at run time, by libc (static PIE) or by
+// ld.so (dynamic): they are not the loader's to skip.
+//
+// Whatever a cache file holds gets mapped and run, and its name is no
+// secret (anyone can stat() the ELF file). So the directory and the file
+// must belong to us and be writable by nobody else, and the header must
+// describe a range that the file actually covers.
+
+#define CACHE_MAGIC "LDRIMG2"
+#define CACHE_NSEG  16
+
+struct cache_header {
+    char magic[8];
+    uint64_t dev, ino, size, mtime_sec, mtime_nsec;  // Key, checked again
+    uint64_t base, span;    // The image occupies [base, base + span)
+    uint32_t type;          // e_type: only an ET_DYN image can move
+    struct image img;       // With img.interp in interp[] below
+    char interp[1024];
+    uint32_t nseg;
+    struct { uint64_t addr, len; uint32_t prot; } seg[CACHE_NSEG];
+};
+
+#define CACHE_DATA PAGE_UP(sizeof(struct cache_header))  // Offset of the image
+
+// Owned by us and not writable by group or others
+static int trusted(int fd, struct stat *st) {
+    return fstat(fd, st) == 0 && st->st_uid == geteuid() &&
+           !(st->st_mode & (S_IWGRP | S_IWOTH));
+}
+
+// Returns the cache directory, opened (or -1 if there is none we can
+// trust), and the name of file's image in it.
+static int cache_key(const char *file, struct stat *st, char *name) {
+    static int warned;
+    struct stat dst;
+    if (!cache_dir || stat(file, st) != 0) return -1;
+    int dir = open(cache_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dir < 0) return -1;
+    if (!trusted(dir, &dst)) {
+        if (!warned++) {
+            fprintf(stderr, "loader: %s: not ours or writable by others, not used\n",
+                    cache_dir);
+        }
+        close(dir);
+        return -1;
+    }
+    snprintf(name, PATH_MAX, "%lx-%lx-%lx-%lx.%09lx.img",
+             (unsigned long)st->st_dev, (unsigned long)st->st_ino, (unsigned long)st->st_size,
+             (unsigned long)st->st_mtim.tv_sec, (unsigned long)st->st_mtim.tv_nsec);
+    return dir;
+}
+
+static int same_key(const struct cache_header *ch, const struct stat *st) {
+    return memcmp(ch->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0 &&
+           ch->dev == (uint64_t)st->st_dev && ch->ino == (uint64_t)st->st_ino &&
+           ch->size == (uint64_t)st->st_size &&
+           ch->mtime_sec == (uint64_t)st->st_mtim.tv_sec &&
+           ch->mtime_nsec == (uint64_t)st->st_mtim.tv_nsec;
+}
+
+// The header describes an image that lies within the cache file (of
+// fsize bytes), with every segment inside it.
+static int sane_header(const struct cache_header *ch, uint64_t fsize) {
+    if (fsize < CACHE_DATA || ch->span > fsize - CACHE_DATA || ch->span == 0 ||
+        (ch->base & (page - 1)) || (ch->span & (page - 1)) ||
+        ch->base + ch->span < ch->base || ch->nseg > CACHE_NSEG ||
+        !memchr(ch->interp, '\0', sizeof(ch->interp))) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < ch->nseg; i++) {
+        uint64_t addr = ch->seg[i].addr, len = ch->seg[i].len;
+        if (addr < ch->base || len > ch->span || addr - ch->base > ch->span - len) return 0;
+    }
+    return 1;
+}
+
+// Map the cached image of file, if there is one that can go at base (for
+// a PIE; 0: anywhere). Returns whether it did.
+static int load_cached(const char *file, uintptr_t base, struct image *img) {
+    struct stat st, fst;
+    struct cache_header ch;
+    char path[PATH_MAX];
+    int dir = cache_key(file, &st, path);
+    if (dir < 0) return 0;
+    int fd = openat(dir, path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    close(dir);
+    if (fd < 0) return 0;
+    if (!trusted(fd, &fst) || !S_ISREG(fst.st_mode) ||
+        pread(fd, &ch, sizeof(ch), 0) != sizeof(ch) || !same_key(&ch, &st) ||
+        !sane_header(&ch, fst.st_size) ||
+        (ch.type == ET_DYN && base && base != ch.base)) {  // ET_EXEC ignores -b
+        close(fd);
+        return 0;
+    }
+
+    void *got = mmap((void *)ch.base, ch.span, PROT_NONE,
+                     MAP_PRIVATE | MAP_FIXED_NOREPLACE, fd, CACHE_DATA);
+    close(fd);
+    if (got == MAP_FAILED) return 0;
+    if (got != (void *)ch.base) {
+        munmap(got, ch.span);
+        return 0;
+    }
+    for (uint32_t i = 0; i < ch.nseg; i++) {
+        if (mprotect((void *)ch.seg[i].addr, ch.seg[i].len, ch.seg[i].prot) != 0) {
+            die(file, "cached image %s: mprotect: %s", path, strerror(errno));
+        }
+    }
 
-    Elf64_Phdr *pht = (Elf64_Phdr *)((char *)h + h->e_phoff);
-    for (int i = 0; i < h->e_phnum; i++) {
+    *img = ch.img;
+    img->interp = ch.interp[0] ? strdup(ch.interp) : NULL;
+    return 1;
+}
+
+// Save the freshly loaded image of file (best effort: any failure just
+// leaves it uncached). The file is written under a temporary name and
+// renamed, so concurrent loaders never map a partial image.
+static void save_cached(const char *file, int type, const struct image *img,
+                        const Elf64_Phdr *pht, int phnum, uintptr_t lo, uintptr_t hi) {
+    struct stat st;
+    char path[PATH_MAX], tmp[PATH_MAX + 16];
+    int dir = cache_key(file, &st, path);
+    if (dir < 0) return;
+
+    struct cache_header ch = {
+        .magic = CACHE_MAGIC,
+        .dev = st.st_dev, .ino = st.st_ino, .size = st.st_size,
+        .mtime_sec = st.st_mtim.tv_sec, .mtime_nsec = st.st_mtim.tv_nsec,
+        .base = lo + img->bias, .span = hi - lo, .type = type,
+        .img = *img,
+    };
+    ch.img.interp = NULL;
+    if (img->interp) {
+        if (strlen(img->interp) >= sizeof(ch.interp)) goto out;
+        strcpy(ch.interp, img->interp);
+    }
+    for (int i = 0; i < phnum; i++) {
+        const Elf64_Phdr *p = &pht[i];
+        if (p->p_type != PT_LOAD) continue;
+        int prot = prot_of(p);
+        if (ch.nseg == CACHE_NSEG || !(prot & PROT_READ)) goto out;
+        uintptr_t beg = PAGE_DOWN(img->bias + p->p_vaddr);
+        uintptr_t end = PAGE_UP(img->bias + p->p_vaddr + p->p_memsz);
+        ch.seg[ch.nseg].addr = beg;
+        ch.seg[ch.nseg].len = end - beg;
+        ch.seg[ch.nseg].prot = prot;
+        ch.nseg++;
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+    int fd = openat(dir, tmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC | O_NOFOLLOW, 0600);
+    if (fd < 0) goto out;
+    int ok = pwrite(fd, &ch, sizeof(ch), 0) == sizeof(ch) &&
+             ftruncate(fd, CACHE_DATA + ch.span) == 0;  // Gaps stay holes
+    for (uint32_t i = 0; ok && i < ch.nseg; i++) {
+        ok = pwrite(fd, (void *)ch.seg[i].addr, ch.seg[i].len,
+                    CACHE_DATA + ch.seg[i].addr - ch.base) == (ssize_t)ch.seg[i].len;
+    }
+    close(fd);
+    if (!ok || renameat(dir, tmp, dir, path) != 0) unlinkat(dir, tmp, 0);
+out:
+    close(dir);
+}
+
+// Load file at its link address (ET_EXEC) or, for ET_DYN, at base (0:
+// anywhere).
+void load_image(const char *file, uintptr_t base, struct image *img) {
+    if (load_cached(file, base, img)) return;
+
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) die(file, "%s", strerror(errno));
+
+    // ELF header and program header table. They are read rather than
+    // mapped: the table does not have to be in the first page.
+    Elf64_Ehdr h;
+    if (pread(fd, &h, sizeof(h), 0) != sizeof(h) ||
+        memcmp(h.e_ident, ELFMAG, SELFMAG) != 0) {
+        die(file, "not an ELF file");
+    }
+    if (h.e_ident[EI_CLASS] != ELFCLASS64 || h.e_ident[EI_DATA] != ELFDATA2LSB ||
+        h.e_machine != EM_X86_64) {
+        die(file, "not an x86-64 ELF file");
+    }
+    if (h.e_type != ET_EXEC && h.e_type != ET_DYN) {
+        die(file, "not an executable (e_type %d)", h.e_type);
+    }
+    if (h.e_phentsize != sizeof(Elf64_Phdr) || h.e_phnum == 0 || h.e_phnum >= PN_XNUM) {
+        die(file, "bad program header table");
+    }
+
+    size_t phsz = h.e_phnum * sizeof(Elf64_Phdr);
+    Elf64_Phdr *pht = malloc(phsz);
+    assert(pht);
+    if (pread(fd, pht, phsz, h.e_phoff) != (ssize_t)phsz) {
+        die(file, "truncated program header table");
+    }
+
+    // Check the segments and find the address range they span
+    uintptr_t lo = UINTPTR_MAX, hi = 0;
+    Elf64_Phdr *tls = NULL;
+    memset(img, 0, sizeof(*img));
+    for (int i = 0; i < h.e_phnum; i++) {
         Elf64_Phdr *p = &pht[i];
+        switch (p->p_type) {
+            case PT_LOAD:
+                if (p->p_filesz > p->p_memsz) die(file, "segment %d: p_filesz > p_memsz", i);
+                if ((p->p_vaddr - p->p_offset) & (page - 1)) {
+                    die(file, "segment %d: p_vaddr and p_offset differ in page offset", i);
+                }
+                if (p->p_vaddr + p->p_memsz < p->p_vaddr) die(file, "segment %d wraps around", i);
+                if (PAGE_DOWN(p->p_vaddr) < lo) lo = PAGE_DOWN(p->p_vaddr);
+                if (PAGE_UP(p->p_vaddr + p->p_memsz) > hi) hi = PAGE_UP(p->p_vaddr + p->p_memsz);
+                break;
+            case PT_INTERP:
+                // A NUL-terminated path, e.g., /lib64/ld-linux-x86-64.so.2
+                if (p->p_filesz < 2 || p->p_filesz > 4096) die(file, "bad PT_INTERP");
+                img->interp = malloc(p->p_filesz);
+                assert(img->interp);
+                if (pread(fd, img->interp, p->p_filesz, p->p_offset) != (ssize_t)p->p_filesz ||
+                    img->interp[p->p_filesz - 1] != '\0') {
+                    die(file, "bad PT_INTERP");
+                }
+                break;
+            case PT_GNU_STACK:
+                img->exec_stack = !!(p->p_flags & PF_X);
+                break;
+            case PT_TLS:
+                tls = p;
+                break;
+        }
+    }
+    if (lo >= hi) die(file, "no loadable segments");
 
-        if (p->p_type == PT_LOAD) {
-            // Memory map region
-            uintptr_t align = p->p_align;
-            uintptr_t map_beg = ROUND(p->p_vaddr, align);
-
-            // Memory map flags
-            int prot = 0;
-            if (p->p_flags & PF_R) prot |= PROT_READ;
-            if (p->p_flags & PF_W) prot |= PROT_WRITE;
-            if (p->p_flags & PF_X) prot |= PROT_EXEC;
-
-            // Memory map size
-            uintptr_t map_sz = ROUND(p->p_filesz + align - 1, align);
-            uintptr_t alloc_sz = p->p_memsz - p->p_filesz;
-
-            // Map file contents
-            mmap(
-                (void *)map_beg,               // addr, rounded to ALIGN
-                map_sz,                        // length
-                prot,                          // protection
-                MAP_PRIVATE | MAP_FIXED,       // flags, private & strict
-                fd, ROUND(p->p_offset, align)  // file and offset
-            );
-
-            // Map anonymous memory (bss)
-            if (alloc_sz > 0) {
-                mmap(
-                    (void *)(map_beg + map_sz),// addr
-                    alloc_sz,                  // length,
-                    prot,                      // protection
-                    MAP_ANONYMOUS | MAP_PRIVATE | MAP_FIXED, // flags
-                    -1, 0                      // no file and offset
-                );
+    // The TLS template (.tdata, then .tbss) is set up by libc from AT_PHDR;
+    // make sure what it will find is sane.
+    if (tls) {
+        int inside = 0;
+        for (int i = 0; i < h.e_phnum; i++) {
+            Elf64_Phdr *p = &pht[i];
+            if (p->p_type == PT_LOAD && p->p_vaddr <= tls->p_vaddr &&
+                tls->p_vaddr + tls->p_filesz <= p->p_vaddr + p->p_filesz) {
+                inside = 1;
             }
+        }
+        if (tls->p_filesz > tls->p_memsz || !power_of_two(tls->p_align ? tls->p_align : 1) ||
+            !inside) {
+            die(file, "bad PT_TLS segment");
+        }
+    }
+
+    // Reserve the whole range first. An ET_EXEC image must go exactly where
+    // it was linked: fail rather than replace the loader's own mappings. A
+    // PIE goes where the kernel puts it (randomized) or at -b.
+    void *want = (void *)lo;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE;
+    if (h.e_type == ET_DYN) {
+        want = (void *)base;
+        if (!base) flags &= ~MAP_FIXED_NOREPLACE;
+    }
+    void *got = mmap(want, hi - lo, PROT_NONE, flags, -1, 0);
+    if (got == MAP_FAILED || (want && got != want)) {
+        die(file, "cannot reserve %#lx bytes at %p: %s", hi - lo, want,
+            got == MAP_FAILED ? strerror(errno) : "address in use");
+    }
+    img->bias = (uintptr_t)got - lo;
 
-            // (Should check for return values.)
+    for (int i = 0; i < h.e_phnum; i++) {
+        if (pht[i].p_type == PT_LOAD) {
+            load_segment(file, fd, &pht[i], img->bias);
         }
     }
     close(fd);
 
-    void *rsp = init_proc_stack(argv, envp);
-    asm volatile(
-        "mov $0, %%rdx;" // required by System-V ABI
-        "mov %0, %%rsp;" // loader allocated
-        "jmp *%1" : : "a"(rsp), "b"(h->e_entry)
-    );
+    // libc finds its own program headers (TLS, RELRO, ...) through AT_PHDR
+    img->phnum = h.e_phnum;
+    for (int i = 0; i < h.e_phnum; i++) {
+        Elf64_Phdr *p = &pht[i];
+        if (p->p_type == PT_PHDR) {
+            img->phdr = img->bias + p->p_vaddr;
+        } else if (!img->phdr && p->p_type == PT_LOAD && p->p_offset <= h.e_phoff &&
+                   h.e_phoff + phsz <= p->p_offset + p->p_filesz) {
+            img->phdr = img->bias + p->p_vaddr + (h.e_phoff - p->p_offset);
+        }
+    }
+    if (!img->phdr) die(file, "program header table is not loaded");
+
+    img->entry = img->bias + h.e_entry;
+    save_cached(file, h.e_type, img, pht, h.e_phnum, lo, hi);
+    free(pht);
 }
 
-void *init_proc_stack(char *argv[], char *envp[]) {
-    _Alignas(16) static char stack[1 << 20];
-    static char rnd[16];
+// The initial process stack, as the kernel's execve builds it:
+//
+//   rsp -> argc, argv[0..argc-1], NULL, envp[...], NULL, auxv[...], AT_NULL
+//          (padding)
+//          16 random bytes, strings (argv, envp, AT_EXECFN, AT_PLATFORM)
+//   top
+//
+// The stack is a fresh mapping as large as RLIMIT_STACK allows (it cannot
+// grow), with a guard page below it.
+void *init_proc_stack(const char *file, char *argv[], char *envp[],
+                      struct image *img, uintptr_t interp_base) {
+    size_t size = 8 << 20;
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_STACK, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY &&
+        rl.rlim_cur < (1UL << 30)) {
+        size = PAGE_UP(rl.rlim_cur < (128 << 10) ? (128 << 10) : rl.rlim_cur);
+    }
+    // PT_GNU_STACK with PF_X (e.g., code that uses trampolines)
+    int prot = PROT_READ | PROT_WRITE | (img->exec_stack ? PROT_EXEC : 0);
+    char *guard = mmap(NULL, size + page, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (guard == MAP_FAILED || mprotect(guard + page, size, prot) != 0) {
+        perror("loader: stack");
+        exit(1);
+    }
+    char *top = guard + page + size;
+
+    // Calculate argc and envc
+    int argc = 0, envc = 0;
+    while (argv[argc])
+        argc++;
+    while (envp[envc])
+        envc++;
 
-    void *sp = (void *)(stack + sizeof(stack) - 8192);
+    // Strings and AT_RANDOM bytes, copied to the top of the stack
+    #define copy_str(top, s) ({ \
+        size_t n = strlen(s) + 1; \
+        top -= n; \
+        memcpy(top, s, n); \
+    })
+    char **args = malloc((argc + envc) * sizeof(char *)), **envs = args + argc;
+    assert(args);
+    for (int i = 0; i < argc; i++) args[i] = copy_str(top, argv[i]);
+    for (int i = 0; i < envc; i++) envs[i] = copy_str(top, envp[i]);
+    char *execfn = copy_str(top, file);
+    char *platform = copy_str(top, "x86_64");
+    top -= 16;
+    char *rnd = top;  // Seeds the stack protector and pointer guard
+    if (getrandom(rnd, 16, 0) != 16) {
+        perror("loader: getrandom");
+        exit(1);
+    }
+
+    // auxv[], AT_NULL-terminated, in the kernel's order. The vDSO is the
+    // loader's own, which stays mapped: with AT_SYSINFO_EHDR, libc calls
+    // its clock_gettime()/gettimeofday() instead of making system calls.
+    Elf64_auxv_t auxv[] = {
+        #define AUX(type, val) {.a_type = (type), .a_un.a_val = (uintptr_t)(val)}
+        AUX(AT_SYSINFO_EHDR, getauxval(AT_SYSINFO_EHDR)),
+        AUX(AT_MINSIGSTKSZ, getauxval(AT_MINSIGSTKSZ)),
+        AUX(AT_HWCAP, getauxval(AT_HWCAP)),
+        AUX(AT_PAGESZ, page),
+        AUX(AT_CLKTCK, sysconf(_SC_CLK_TCK)),
+        AUX(AT_PHDR, img->phdr),    // libc: TLS and RELRO of the program
+        AUX(AT_PHENT, sizeof(Elf64_Phdr)),
+        AUX(AT_PHNUM, img->phnum),
+        AUX(AT_BASE, interp_base),  // Where ld.so is (0: none)
+        AUX(AT_FLAGS, 0),
+        AUX(AT_ENTRY, img->entry),
+        AUX(AT_UID, getuid()),
+        AUX(AT_EUID, geteuid()),
+        AUX(AT_GID, getgid()),
+        AUX(AT_EGID, getegid()),
+        AUX(AT_SECURE, getauxval(AT_SECURE)),
+        AUX(AT_RANDOM, rnd),
+        AUX(AT_HWCAP2, getauxval(AT_HWCAP2)),
+        AUX(AT_EXECFN, execfn),
+        AUX(AT_PLATFORM, platform),
+        AUX(AT_NULL, 0),
+    };
+    // Like the kernel, leave out what this machine does not have, rather
+    // than pass a 0 that libc would take over its own default.
+    int nauxv = 0;
+    for (size_t i = 0; i < sizeof(auxv) / sizeof(auxv[0]); i++) {
+        uint64_t type = auxv[i].a_type;
+        if (auxv[i].a_un.a_val == 0 &&
+            (type == AT_SYSINFO_EHDR || type == AT_MINSIGSTKSZ || type == AT_HWCAP2)) {
+            continue;
+        }
+        auxv[nauxv++] = auxv[i];
+    }
+
+    // rsp must be 16-byte aligned at the entry point
+    size_t nword = 1 + (argc + 1) + (envc + 1) + 2 * nauxv;
+    void *sp = (void *)(((uintptr_t)top - nword * sizeof(intptr_t)) & ~15UL);
     #define push(sp, T, ...) ({ \
         *((T*)sp) = (T)__VA_ARGS__; \
         sp = (void *)((uintptr_t)(sp) + sizeof(T)); \
@@ -96,36 +572,23 @@ void *init_proc_stack(char *argv[], char *envp[]) {
 
     void *rsp = sp;
 
-    // Calculate argc
-    int argc = 0;
-    while (argv[argc])
-        argc++;
-
     // Create initial process stack
     push(sp, intptr_t, argc);
 
     // argv[], NULL-terminate
     for (int i = 0; i < argc; i++) {
-        push(sp, intptr_t, argv[i]);
+        push(sp, intptr_t, args[i]);
     }
     push(sp, intptr_t, 0);
 
     // envp[], NULL-terminate
-    for (; *envp; envp++) {
-        if (!strchr(*envp, '_')) {
-            // remove some verbose ones
-            push(sp, intptr_t, *envp);
-        }
+    for (int i = 0; i < envc; i++) {
+        push(sp, intptr_t, envs[i]);
     }
     push(sp, intptr_t, 0);
 
-    // auxv[], AT_NULL-terminate
-    push(sp, Elf64_auxv_t,
-        {.a_type = AT_RANDOM, .a_un.a_val = (uintptr_t)rnd}
-    );
-    push(sp, Elf64_auxv_t,
-        {.a_type = AT_NULL}
-    );
+    memcpy(sp, auxv, nauxv * sizeof(auxv[0]));
+    free(args);
 
     // This stack layout is defined by System-V ABI.
     return rsp;
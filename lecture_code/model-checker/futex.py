@@ -69,3 +69,11 @@ class Futex:
                 count += 1
         if count > 1:
             return 'red'
+
+    @invariant
+    def mutual_exclusion(self, state):
+        count = 0
+        for t in ['t1', 't2', 't3']:
+            if localvar(state, t, 'cs'):
+                count += 1
+        return count <= 1
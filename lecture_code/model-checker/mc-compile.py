@@ -0,0 +1,350 @@
+import ast, importlib, sys
+
+# Compile a model (the @mc.thread/@mc.marker class read by model-checker.py)
+# into the bytecode run by the native checker (mc.cc).
+#
+# Thread functions are compiled from the *hacked* source, so every
+# `yield checkpoint()` becomes a YIELD with the same line number that
+# model-checker.py reports. Helper methods run atomically inside a step, as
+# they do in Python. Markers and invariants are compiled from the original
+# source.
+#
+# Only a subset of Python is supported: int/bool/str/None/list/tuple
+# values, assignments (including tuple unpacking and subscripts), if/while/
+# for, break/continue/return/del, helper method calls, and the builtins
+# below. Anything else is reported as an error.
+
+mc = importlib.import_module('model-checker')
+
+BINOPS = {ast.Add: 'ADD', ast.Sub: 'SUB', ast.Mult: 'MUL',
+          ast.Mod: 'MOD', ast.FloorDiv: 'FLOORDIV'}
+CMPOPS = {ast.Eq: 'EQ', ast.NotEq: 'NE', ast.Lt: 'LT', ast.LtE: 'LE',
+          ast.Gt: 'GT', ast.GtE: 'GE', ast.In: 'IN', ast.NotIn: 'NOTIN',
+          ast.Is: 'IS', ast.IsNot: 'ISNOT'}
+BUILTINS = ['len', 'range', 'abs', 'min', 'max', 'bool']
+
+class CompileError(Exception):
+    pass
+
+def encode(val):
+    '''Encode a constant as bytecode tokens'''
+    if val is None: return 'N'
+    if val is True: return 'T'
+    if val is False: return 'F'
+    if type(val) == int: return f'i{val}'
+    if type(val) == str: return 's' + val.encode('utf-8').hex()
+    if type(val) in [list, tuple]:
+        tag = 'l' if type(val) == list else 't'
+        return ' '.join([f'{tag}{len(val)}'] + [encode(x) for x in val])
+    raise CompileError(f'unsupported value {val!r}')
+
+class Program:
+    def __init__(self, gvars, helpers):
+        self.consts, self.funcs = [], []
+        self.gvars = gvars
+        # Helper methods are compiled first: name -> (function index, nargs)
+        self.helpers = {n.name: (i, len(n.args.args) - 1) for i, n in enumerate(helpers)}
+
+    def const(self, val):
+        key = (type(val), val if type(val) not in [list] else tuple(val))
+        for i, (k, _) in enumerate(self.consts):
+            if k == key: return i
+        self.consts.append((key, val))
+        return len(self.consts) - 1
+
+class Function:
+    def __init__(self, prog, node, visible, threaded=False):
+        self.prog, self.name = prog, node.name
+        self.threaded = threaded  # Has checkpoints (a @mc.thread body)
+        self.args = [a.arg for a in node.args.args][1:]  # Drop self
+        self.locals = list(visible)
+        for a in self.args:
+            if a not in self.locals: self.locals.append(a)
+        if not threaded:
+            # Like Python's symbol table: anything assigned is a local.
+            for n in ast.walk(node):
+                if isinstance(n, ast.Name) and not isinstance(n.ctx, ast.Load) \
+                        and n.id not in self.locals:
+                    self.locals.append(n.id)
+        self.nvisible = len(self.locals)
+        self.code, self.loops, self.nfor = [], [], 0
+
+        for stmt in node.body:
+            self.stmt(stmt)
+        self.emit('CONST', prog.const(None))
+        self.emit('RETURN')
+
+    def error(self, node, msg):
+        raise CompileError(f'line {getattr(node, "lineno", "?")}: {msg}')
+
+    def emit(self, op, a=0, b=0):
+        self.code.append([op, a, b])
+        return len(self.code) - 1
+
+    def here(self):
+        return len(self.code)
+
+    def patch(self, at, target):
+        self.code[at][1] = target
+
+    def local(self, name, hidden=False):
+        if name not in self.locals:
+            if not self.threaded or hidden:
+                self.locals.append(name)
+            else:
+                raise CompileError(f'unknown local {name}')
+        return self.locals.index(name)
+
+    def gvar(self, node):
+        if node.attr not in self.prog.gvars:
+            self.error(node, f'unknown attribute self.{node.attr}')
+        return self.prog.gvars.index(node.attr)
+
+    @staticmethod
+    def is_self(node):
+        return isinstance(node, ast.Name) and node.id == 'self'
+
+    # Statements
+
+    def stmt(self, node):
+        match node:
+            case ast.Expr(value=ast.Yield(value=ast.Call(func=ast.Name(id='checkpoint')))):
+                if not self.threaded: self.error(node, 'checkpoint outside a thread')
+                self.emit('YIELD', node.lineno)
+            case ast.Expr(value=value):
+                self.expr(value)
+                self.emit('POP')
+            case ast.Pass():
+                pass
+            case ast.Assign(targets=targets, value=value):
+                self.expr(value)
+                for i, t in enumerate(targets):
+                    if i + 1 < len(targets): self.emit('DUP')
+                    self.store(t)
+            case ast.AugAssign(target=target, op=op, value=value):
+                if type(op) not in BINOPS: self.error(node, 'unsupported operator')
+                self.expr(target)  # The subscript (if any) is evaluated twice
+                self.expr(value)
+                self.emit('BINOP', BINOPS[type(op)])
+                self.store(target)
+            case ast.Delete(targets=targets):
+                for t in targets:
+                    if isinstance(t, ast.Name):
+                        self.emit('DEL_LOCAL', self.local(t.id))
+                    elif isinstance(t, ast.Attribute) and self.is_self(t.value):
+                        self.emit('DEL_GLOBAL', self.gvar(t))
+                    else:
+                        self.error(node, 'unsupported del')
+            case ast.If(test=test, body=body, orelse=orelse):
+                self.expr(test)
+                jf = self.emit('JUMP_IF_FALSE')
+                for s in body: self.stmt(s)
+                if orelse:
+                    j = self.emit('JUMP')
+                    self.patch(jf, self.here())
+                    for s in orelse: self.stmt(s)
+                    self.patch(j, self.here())
+                else:
+                    self.patch(jf, self.here())
+            case ast.While(test=test, body=body, orelse=[]):
+                start, jf = self.here(), None
+                if not (isinstance(test, ast.Constant) and test.value is True):
+                    self.expr(test)
+                    jf = self.emit('JUMP_IF_FALSE')
+                self.loops.append((start, []))
+                for s in body: self.stmt(s)
+                self.emit('JUMP', start)
+                _, breaks = self.loops.pop()
+                for at in breaks + ([jf] if jf is not None else []):
+                    self.patch(at, self.here())
+            case ast.For(target=target, iter=it, body=body, orelse=[]):
+                # The sequence and the position live in hidden locals, which
+                # are part of the thread's state but not shown (as in Python).
+                seq = self.local(f'.for{self.nfor}', hidden=True)
+                self.local(f'.for{self.nfor}i', hidden=True)
+                self.nfor += 1
+                self.expr(it)
+                self.emit('STORE_LOCAL', seq)
+                self.emit('CONST', self.prog.const(0))
+                self.emit('STORE_LOCAL', seq + 1)
+                start = self.emit('FOR_ITER', 0, seq)
+                self.store(target)
+                self.loops.append((start, []))
+                for s in body: self.stmt(s)
+                self.emit('JUMP', start)
+                _, breaks = self.loops.pop()
+                self.patch(start, self.here())
+                for at in breaks: self.patch(at, self.here())
+            case ast.Break():
+                if not self.loops: self.error(node, 'break outside a loop')
+                self.loops[-1][1].append(self.emit('JUMP'))
+            case ast.Continue():
+                if not self.loops: self.error(node, 'continue outside a loop')
+                self.emit('JUMP', self.loops[-1][0])
+            case ast.Return(value=value):
+                if value is None: self.emit('CONST', self.prog.const(None))
+                else: self.expr(value)
+                self.emit('RETURN')
+            case _:
+                self.error(node, f'unsupported statement {type(node).__name__}')
+
+    def store(self, node):
+        match node:
+            case ast.Name(id=name):
+                self.emit('STORE_LOCAL', self.local(name))
+            case ast.Attribute(value=v) if self.is_self(v):
+                self.emit('STORE_GLOBAL', self.gvar(node))
+            case ast.Subscript(value=ast.Name(id=name), slice=index) if name != 'self':
+                self.expr(index)
+                self.emit('STORE_SUBSCR_LOCAL', self.local(name))
+            case ast.Subscript(value=ast.Attribute(value=v) as attr, slice=index) if self.is_self(v):
+                self.expr(index)
+                self.emit('STORE_SUBSCR_GLOBAL', self.gvar(attr))
+            case ast.Tuple(elts=elts) | ast.List(elts=elts):
+                self.emit('UNPACK', len(elts))
+                for e in elts: self.store(e)
+            case _:
+                self.error(node, f'unsupported assignment target {ast.dump(node)}')
+
+    # Expressions
+
+    def expr(self, node):
+        match node:
+            case ast.Constant(value=value):
+                self.emit('CONST', self.prog.const(value))
+            case ast.Name(id=name):
+                if name not in self.locals: self.error(node, f'unknown name {name}')
+                self.emit('LOAD_LOCAL', self.locals.index(name))
+            case ast.Attribute(value=v) if self.is_self(v):
+                self.emit('LOAD_GLOBAL', self.gvar(node))
+            case ast.Subscript(value=value, slice=ast.Slice(lower=lo, upper=hi, step=None)):
+                self.expr(value)
+                for x in [lo, hi]:
+                    if x is None: self.emit('CONST', self.prog.const(None))
+                    else: self.expr(x)
+                self.emit('SLICE')
+            case ast.Subscript(value=value, slice=index):
+                self.expr(value)
+                self.expr(index)
+                self.emit('INDEX')
+            case ast.BinOp(left=l, op=op, right=r) if type(op) in BINOPS:
+                self.expr(l)
+                self.expr(r)
+                self.emit('BINOP', BINOPS[type(op)])
+            case ast.UnaryOp(op=ast.Not(), operand=x):
+                self.expr(x)
+                self.emit('NOT')
+            case ast.UnaryOp(op=ast.USub(), operand=x):
+                self.expr(x)
+                self.emit('NEG')
+            case ast.BoolOp(op=op, values=values):
+                jumps = []
+                for i, v in enumerate(values):
+                    self.expr(v)
+                    if i + 1 < len(values):
+                        jumps.append(self.emit('JUMP_IF_FALSE_OR_POP'
+                            if isinstance(op, ast.And) else 'JUMP_IF_TRUE_OR_POP'))
+                for at in jumps: self.patch(at, self.here())
+            case ast.Compare(left=l, ops=[op], comparators=[r]):
+                self.expr(l)
+                self.expr(r)
+                self.emit('CMP', CMPOPS[type(op)])
+            case ast.IfExp(test=test, body=body, orelse=orelse):
+                self.expr(test)
+                jf = self.emit('JUMP_IF_FALSE')
+                self.expr(body)
+                j = self.emit('JUMP')
+                self.patch(jf, self.here())
+                self.expr(orelse)
+                self.patch(j, self.here())
+            case ast.Tuple(elts=elts) | ast.List(elts=elts):
+                for e in elts: self.expr(e)
+                self.emit('BUILD_TUPLE' if isinstance(node, ast.Tuple) else 'BUILD_LIST', len(elts))
+            case ast.Call(func=ast.Attribute(value=v, attr=attr), args=args, keywords=[]) \
+                    if self.is_self(v) and attr in self.prog.helpers:
+                idx, nargs = self.prog.helpers[attr]
+                if len(args) != nargs:
+                    self.error(node, f'{attr}() takes {nargs} arguments')
+                for a in args: self.expr(a)
+                self.emit('CALL', idx, nargs)
+            case ast.Call(func=ast.Name(id='localvar'), args=[_, t, name], keywords=[]):
+                self.expr(t)
+                self.expr(name)
+                self.emit('LOCALVAR')
+            case ast.Call(func=ast.Name(id=name), args=args, keywords=[]) if name in BUILTINS:
+                for a in args: self.expr(a)
+                self.emit('CALL_BUILTIN', BUILTINS.index(name), len(args))
+            case _:
+                self.error(node, f'unsupported expression {ast.unparse(node)}')
+
+def class_def(src):
+    return [n for n in ast.parse(src).body if isinstance(n, ast.ClassDef)].pop()
+
+def compile_model(path):
+    Class = mc.hack(mc.load(path))
+    hacked = class_def(Class.hacked_src)
+    original = class_def(Class.source)
+    fns = {n.name: n for n in hacked.body if isinstance(n, ast.FunctionDef)}
+    marker_names = [f.__name__ for f in mc.marker_fn]
+    invariant_names = [f.__name__ for f in mc.invariant_fn]
+
+    # Globals: what execute() would list for a fresh object (dir() order),
+    # plus attributes that are only ever assigned by the code.
+    obj, gvars, init = Class.hacked(), [], {}
+    for attr in dir(obj):
+        val = getattr(obj, attr)
+        if not attr.startswith('__') and type(val) in [bool, int, str, list, tuple]:
+            gvars.append(attr)
+            init[attr] = val
+    for n in ast.walk(hacked):
+        if isinstance(n, ast.Attribute) and isinstance(n.ctx, ast.Store) \
+                and Function.is_self(n.value) and n.attr not in gvars:
+            gvars.append(n.attr)
+    gvars.sort()
+
+    helpers = [n for name, n in fns.items() if name not in mc.threads]
+    prog = Program(gvars, helpers)
+    for n in helpers:
+        prog.funcs.append(Function(prog, n, []))
+
+    threads = []
+    for t in mc.threads:
+        code = getattr(Class.hacked, t).__code__
+        visible = [v for v in code.co_varnames if v != 'self']
+        prog.funcs.append(Function(prog, fns[t], visible, threaded=True))
+        threads.append(len(prog.funcs) - 1)
+
+    markers, invariants = [], []
+    for n in original.body:
+        if isinstance(n, ast.FunctionDef) and n.name in marker_names:
+            prog.funcs.append(Function(prog, n, []))
+            markers.append(len(prog.funcs) - 1)
+        elif isinstance(n, ast.FunctionDef) and n.name in invariant_names:
+            prog.funcs.append(Function(prog, n, []))
+            invariants.append(len(prog.funcs) - 1)
+
+    out = [f'class {encode(Class.hacked_src)}']
+    for _, val in prog.consts:
+        out.append(f'const {encode(val)}')
+    for g in gvars:
+        out.append(f'global {g} {encode(init[g]) if g in init else "U"}')
+    for t, f in zip(mc.threads, threads):
+        out.append(f'thread {t} {f}')
+    for f in markers:
+        out.append(f'marker {f}')
+    for f in invariants:
+        out.append(f'invariant {f}')
+    for f in prog.funcs:
+        out.append(' '.join(['func', f.name, str(len(f.args)), str(len(f.locals)),
+                             str(f.nvisible)] + f.locals))
+        for op, a, b in f.code:
+            out.append(f'{op} {a} {b}')
+        out.append('end')
+    return '\n'.join(out) + '\n'
+
+if __name__ == '__main__':
+    try:
+        sys.stdout.write(compile_model(sys.argv[1]))
+    except CompileError as e:
+        print(f'{sys.argv[1]}: {e}', file=sys.stderr)
+        sys.exit(1)
@@ -0,0 +1,1948 @@
+// Native model checker: explores the state space of a model compiled by
+// mc-compile.py and prints the same CLASS/STATE/TRANS lines (or, with -J,
+// JSON lines) as model-checker.py, so visualize.py works unchanged.
+//
+// Instead of replaying a trace from the start for every new state, each
+// state holds its threads' program counters, locals and the globals, and a
+// successor is a copy of its parent advanced by one step. States are
+// identified by what model-checker.py prints (checkpoint lines, visible
+// locals, globals); the first state found for a key is the one explored.
+//
+// States are expanded by -j worker threads (default: one per CPU), one BFS
+// level at a time; the output is the same for any number of workers.
+// With -H or -B only fingerprints (or bits) of visited states are kept,
+// and a summary is printed instead of the graph. -R samples the state
+// space with random walks instead of exploring all of it.
+//
+//   python3 mc-compile.py mutex-bad.py > /tmp/mutex-bad.bc
+//   ./mc -j 8 /tmp/mutex-bad.bc | python3 visualize.py > display.html
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+using std::string, std::u32string, std::vector;
+
+[[noreturn]] static void panic(const string &msg) {
+  std::cerr << "mc: " << msg << std::endl;
+  exit(1);
+}
+
+// Values
+
+struct Value {
+  enum Kind : uint8_t { UNBOUND, NONE, BOOL, INT, STR, LIST, TUPLE };
+  Kind kind = UNBOUND;
+  long i = 0;
+  u32string s;
+  vector<Value> items;
+
+  static Value none() { Value v; v.kind = NONE; return v; }
+  static Value boolean(bool b) { Value v; v.kind = BOOL; v.i = b; return v; }
+  static Value integer(long i) { Value v; v.kind = INT; v.i = i; return v; }
+  static Value str(u32string s) { Value v; v.kind = STR; v.s = std::move(s); return v; }
+  static Value seq(Kind k, vector<Value> items) {
+    Value v; v.kind = k; v.items = std::move(items); return v;
+  }
+
+  bool is_int() const { return kind == INT || kind == BOOL; }
+  bool is_seq() const { return kind == LIST || kind == TUPLE; }
+};
+
+static bool truthy(const Value &v) {
+  switch (v.kind) {
+    case Value::BOOL: case Value::INT: return v.i != 0;
+    case Value::STR: return !v.s.empty();
+    case Value::LIST: case Value::TUPLE: return !v.items.empty();
+    default: return false;
+  }
+}
+
+static bool equal(const Value &a, const Value &b) {
+  if (a.is_int() && b.is_int()) return a.i == b.i;
+  if (a.kind != b.kind) return false;
+  switch (a.kind) {
+    case Value::STR: return a.s == b.s;
+    case Value::LIST: case Value::TUPLE:
+      if (a.items.size() != b.items.size()) return false;
+      for (size_t k = 0; k < a.items.size(); k++) {
+        if (!equal(a.items[k], b.items[k])) return false;
+      }
+      return true;
+    default: return true;
+  }
+}
+
+// -1, 0, 1 for a < b, a == b, a > b
+static int compare(const Value &a, const Value &b) {
+  if (a.is_int() && b.is_int()) return (a.i > b.i) - (a.i < b.i);
+  if (a.kind == Value::STR && b.kind == Value::STR) return a.s.compare(b.s) < 0 ? -1 : a.s != b.s;
+  if (a.is_seq() && a.kind == b.kind) {
+    for (size_t k = 0; k < a.items.size() && k < b.items.size(); k++) {
+      if (int c = compare(a.items[k], b.items[k])) return c;
+    }
+    return (a.items.size() > b.items.size()) - (a.items.size() < b.items.size());
+  }
+  panic("unorderable types");
+}
+
+static void utf8(char32_t c, string &out) {
+  if (c < 0x80) {
+    out += char(c);
+  } else if (c < 0x800) {
+    out += char(0xc0 | (c >> 6));
+    out += char(0x80 | (c & 0x3f));
+  } else if (c < 0x10000) {
+    out += char(0xe0 | (c >> 12));
+    out += char(0x80 | ((c >> 6) & 0x3f));
+    out += char(0x80 | (c & 0x3f));
+  } else {
+    out += char(0xf0 | (c >> 18));
+    out += char(0x80 | ((c >> 12) & 0x3f));
+    out += char(0x80 | ((c >> 6) & 0x3f));
+    out += char(0x80 | (c & 0x3f));
+  }
+}
+
+// Approximates Python's str.isprintable() outside ASCII.
+static bool printable(char32_t c) {
+  if (c < 0x20 || c == 0x7f) return false;
+  if (c < 0x7f) return true;
+  return !(c <= 0xa0 || c == 0xad || (c >= 0x2000 && c <= 0x200f) ||
+           (c >= 0x2028 && c <= 0x202f) || (c >= 0x205f && c <= 0x206f) ||
+           c == 0x3000 || c == 0xfeff || (c >= 0xd800 && c <= 0xf8ff) ||
+           (c >= 0xe0000));
+}
+
+// JSON string, as Python's json.dumps(ensure_ascii=False) writes it
+static void json_str(const u32string &s, string &out) {
+  out += '"';
+  for (char32_t c : s) {
+    char buf[8];
+    if (c == U'"' || c == U'\\') { out += '\\'; out += char(c); }
+    else if (c == U'\n') out += "\\n";
+    else if (c == U'\r') out += "\\r";
+    else if (c == U'\t') out += "\\t";
+    else if (c == U'\b') out += "\\b";
+    else if (c == U'\f') out += "\\f";
+    else if (c < 0x20) { snprintf(buf, sizeof(buf), "\\u%04x", c); out += buf; }
+    else utf8(c, out);
+  }
+  out += '"';
+}
+
+// Python's repr(), or with json, Python's json.dumps()
+static void repr(const Value &v, string &out, bool json = false) {
+  switch (v.kind) {
+    case Value::UNBOUND: out += "<unbound>"; break;
+    case Value::NONE: out += json ? "null" : "None"; break;
+    case Value::BOOL: out += v.i ? (json ? "true" : "True") : (json ? "false" : "False"); break;
+    case Value::INT: out += std::to_string(v.i); break;
+    case Value::STR: {
+      if (json) {
+        json_str(v.s, out);
+        break;
+      }
+      char q = (v.s.find(U'\'') != u32string::npos &&
+                v.s.find(U'"') == u32string::npos) ? '"' : '\'';
+      out += q;
+      for (char32_t c : v.s) {
+        char buf[16];
+        if (c == char32_t(q) || c == U'\\') { out += '\\'; out += char(c); }
+        else if (c == U'\n') out += "\\n";
+        else if (c == U'\r') out += "\\r";
+        else if (c == U'\t') out += "\\t";
+        else if (printable(c)) utf8(c, out);
+        else {
+          snprintf(buf, sizeof(buf), c < 0x100 ? "\\x%02x" : c < 0x10000 ? "\\u%04x" : "\\U%08x", c);
+          out += buf;
+        }
+      }
+      out += q;
+      break;
+    }
+    case Value::LIST: case Value::TUPLE: {
+      bool list = v.kind == Value::LIST || json;
+      out += list ? '[' : '(';
+      for (size_t k = 0; k < v.items.size(); k++) {
+        if (k) out += ", ";
+        repr(v.items[k], out, json);
+      }
+      if (!list && v.items.size() == 1) out += ',';
+      out += list ? ']' : ')';
+      break;
+    }
+  }
+}
+
+// Bytecode
+
+enum Op {
+  CONST, LOAD_LOCAL, STORE_LOCAL, DEL_LOCAL, LOAD_GLOBAL, STORE_GLOBAL,
+  DEL_GLOBAL, STORE_SUBSCR_LOCAL, STORE_SUBSCR_GLOBAL, INDEX, SLICE, BINOP,
+  CMP, NOT, NEG, JUMP, JUMP_IF_FALSE, JUMP_IF_FALSE_OR_POP,
+  JUMP_IF_TRUE_OR_POP, BUILD_LIST, BUILD_TUPLE, UNPACK, DUP, POP, FOR_ITER,
+  CALL, CALL_BUILTIN, LOCALVAR, RETURN, YIELD,
+};
+
+static const char *op_names[] = {
+  "CONST", "LOAD_LOCAL", "STORE_LOCAL", "DEL_LOCAL", "LOAD_GLOBAL", "STORE_GLOBAL",
+  "DEL_GLOBAL", "STORE_SUBSCR_LOCAL", "STORE_SUBSCR_GLOBAL", "INDEX", "SLICE", "BINOP",
+  "CMP", "NOT", "NEG", "JUMP", "JUMP_IF_FALSE", "JUMP_IF_FALSE_OR_POP",
+  "JUMP_IF_TRUE_OR_POP", "BUILD_LIST", "BUILD_TUPLE", "UNPACK", "DUP", "POP", "FOR_ITER",
+  "CALL", "CALL_BUILTIN", "LOCALVAR", "RETURN", "YIELD",
+};
+
+static const char *binop_names[] = { "ADD", "SUB", "MUL", "MOD", "FLOORDIV" };
+enum { ADD, SUB, MUL, MOD, FLOORDIV };
+static const char *cmp_names[] = { "EQ", "NE", "LT", "LE", "GT", "GE", "IN", "NOTIN", "IS", "ISNOT" };
+enum { EQ, NE, LT, LE, GT, GE, IN, NOTIN, IS, ISNOT };
+enum { B_LEN, B_RANGE, B_ABS, B_MIN, B_MAX, B_BOOL };
+
+struct Instr {
+  Op op;
+  int a, b;
+};
+
+struct Function {
+  string name;
+  int nargs, nlocals, nvisible;
+  vector<string> local_names;
+  vector<Instr> code;
+};
+
+struct Program {
+  Value class_src;  // The hacked source
+  vector<Value> consts;
+  vector<string> gvar_names;
+  vector<Value> gvar_init;
+  vector<string> thread_names;
+  vector<int> thread_fn, markers, invariants;
+  vector<Function> funcs;
+} prog;
+
+static int lookup(const char **names, int n, const string &name) {
+  for (int k = 0; k < n; k++) {
+    if (name == names[k]) return k;
+  }
+  panic("unknown name in bytecode: " + name);
+}
+
+static Value decode(std::istream &in) {
+  string tok;
+  if (!(in >> tok)) panic("truncated value");
+  switch (tok[0]) {
+    case 'U': return Value();
+    case 'N': return Value::none();
+    case 'T': return Value::boolean(true);
+    case 'F': return Value::boolean(false);
+    case 'i': return Value::integer(std::stol(tok.substr(1)));
+    case 's': {
+      string bytes;
+      for (size_t k = 1; k + 1 < tok.size(); k += 2) {
+        bytes += char(std::stoi(tok.substr(k, 2), nullptr, 16));
+      }
+      u32string s;
+      for (size_t k = 0; k < bytes.size();) {
+        unsigned char c = bytes[k];
+        int len = c < 0x80 ? 1 : c < 0xe0 ? 2 : c < 0xf0 ? 3 : 4;
+        char32_t cp = len == 1 ? c : c & (0x3f >> (len - 1));
+        for (int j = 1; j < len; j++) cp = (cp << 6) | (bytes[k + j] & 0x3f);
+        s += cp;
+        k += len;
+      }
+      return Value::str(s);
+    }
+    case 'l': case 't': {
+      vector<Value> items(std::stoi(tok.substr(1)));
+      for (auto &x : items) x = decode(in);
+      return Value::seq(tok[0] == 'l' ? Value::LIST : Value::TUPLE, items);
+    }
+  }
+  panic("bad value: " + tok);
+}
+
+static void load(std::istream &in) {
+  string line;
+  while (std::getline(in, line)) {
+    std::istringstream ls(line);
+    string kind;
+    ls >> kind;
+    if (kind == "class") {
+      prog.class_src = decode(ls);
+    } else if (kind == "const") {
+      prog.consts.push_back(decode(ls));
+    } else if (kind == "global") {
+      string name;
+      ls >> name;
+      prog.gvar_names.push_back(name);
+      prog.gvar_init.push_back(decode(ls));
+    } else if (kind == "thread") {
+      string name;
+      int f;
+      ls >> name >> f;
+      prog.thread_names.push_back(name);
+      prog.thread_fn.push_back(f);
+    } else if (kind == "marker") {
+      int f;
+      ls >> f;
+      prog.markers.push_back(f);
+    } else if (kind == "invariant") {
+      int f;
+      ls >> f;
+      prog.invariants.push_back(f);
+    } else if (kind == "func") {
+      Function fn;
+      ls >> fn.name >> fn.nargs >> fn.nlocals >> fn.nvisible;
+      fn.local_names.resize(fn.nlocals);
+      for (auto &name : fn.local_names) ls >> name;
+      while (std::getline(in, line) && line != "end") {
+        std::istringstream is(line);
+        string op, arg;
+        Instr ins;
+        is >> op >> arg >> ins.b;
+        ins.op = Op(lookup(op_names, sizeof(op_names) / sizeof(op_names[0]), op));
+        if (ins.op == BINOP) ins.a = lookup(binop_names, 5, arg);
+        else if (ins.op == CMP) ins.a = lookup(cmp_names, 10, arg);
+        else ins.a = std::stoi(arg);
+        fn.code.push_back(ins);
+      }
+      prog.funcs.push_back(fn);
+    } else if (!kind.empty()) {
+      panic("bad line: " + line);
+    }
+  }
+  if (prog.thread_fn.empty()) panic("no @thread functions");
+}
+
+// States
+
+struct Thread {
+  bool alive = true;
+  int pc = 0, line = 0;
+  vector<Value> locals;
+};
+
+struct State {
+  vector<Value> globals;
+  vector<Thread> threads;
+};
+
+// Compact encoding
+//
+// A state is serialized into a byte string: for each thread an alive
+// flag, then its pc, checkpoint line and all locals; then the globals.
+// Integers are zigzag varints, strings UTF-8 with a varint length, and
+// lists/tuples a varint count followed by their items. The encoding is
+// canonical (equal states give equal bytes), so it doubles as the state's
+// identity where one is needed, and it is how the BFS frontier is stored.
+
+static void put_varint(string &out, uint64_t x) {
+  while (x >= 0x80) {
+    out += char(x | 0x80);
+    x >>= 7;
+  }
+  out += char(x);
+}
+
+static uint64_t get_varint(const char *&p) {
+  uint64_t x = 0;
+  for (int shift = 0;; shift += 7) {
+    unsigned char c = *p++;
+    x |= uint64_t(c & 0x7f) << shift;
+    if (c < 0x80) return x;
+  }
+}
+
+static void pack_value(const Value &v, string &out) {
+  out += char(v.kind);
+  switch (v.kind) {
+    case Value::BOOL: case Value::INT:
+      put_varint(out, (uint64_t(v.i) << 1) ^ uint64_t(v.i >> 63));
+      break;
+    case Value::STR: {
+      string bytes;
+      for (char32_t c : v.s) utf8(c, bytes);
+      put_varint(out, bytes.size());
+      out += bytes;
+      break;
+    }
+    case Value::LIST: case Value::TUPLE:
+      put_varint(out, v.items.size());
+      for (auto &x : v.items) pack_value(x, out);
+      break;
+    default: break;
+  }
+}
+
+static Value unpack_value(const char *&p) {
+  Value v;
+  v.kind = Value::Kind(*p++);
+  switch (v.kind) {
+    case Value::BOOL: case Value::INT: {
+      uint64_t z = get_varint(p);
+      v.i = long(z >> 1) ^ -long(z & 1);
+      break;
+    }
+    case Value::STR: {
+      size_t len = get_varint(p);
+      const char *end = p + len;
+      while (p < end) {
+        unsigned char c = *p;
+        int len = c < 0x80 ? 1 : c < 0xe0 ? 2 : c < 0xf0 ? 3 : 4;
+        char32_t cp = len == 1 ? c : c & (0x3f >> (len - 1));
+        for (int j = 1; j < len; j++) cp = (cp << 6) | (p[j] & 0x3f);
+        v.s += cp;
+        p += len;
+      }
+      break;
+    }
+    case Value::LIST: case Value::TUPLE:
+      v.items.resize(get_varint(p));
+      for (auto &x : v.items) x = unpack_value(p);
+      break;
+    default: break;
+  }
+  return v;
+}
+
+static string pack(const State &s) {
+  string out;
+  for (auto &th : s.threads) {
+    out += char(th.alive);
+    if (!th.alive) continue;
+    put_varint(out, th.pc);
+    put_varint(out, th.line);
+    for (auto &x : th.locals) pack_value(x, out);
+  }
+  for (auto &g : s.globals) pack_value(g, out);
+  return out;
+}
+
+static State unpack(const string &bytes) {
+  const char *p = bytes.data();
+  State s;
+  s.threads.resize(prog.thread_fn.size());
+  for (size_t t = 0; t < s.threads.size(); t++) {
+    auto &th = s.threads[t];
+    th.alive = *p++;
+    if (!th.alive) continue;
+    th.pc = get_varint(p);
+    th.line = get_varint(p);
+    th.locals.resize(prog.funcs[prog.thread_fn[t]].nlocals);
+    for (auto &x : th.locals) x = unpack_value(p);
+  }
+  s.globals.resize(prog.gvar_names.size());
+  for (auto &g : s.globals) g = unpack_value(p);
+  return s;
+}
+
+// Identity of a state in the graph output: exactly what model-checker.py
+// prints and hashes (checkpoint line and bound visible locals of live
+// threads, and globals of a printable type), in the same encoding. Hidden
+// locals, such as for-loop positions, are not part of the key.
+static bool visible_global(const Value &v) {
+  return v.kind != Value::UNBOUND && v.kind != Value::NONE;
+}
+
+static string state_key(const State &s) {
+  string key;
+  for (size_t t = 0; t < s.threads.size(); t++) {
+    auto &th = s.threads[t];
+    key += char(th.alive);
+    if (!th.alive) continue;
+    put_varint(key, th.line);
+    int nvisible = prog.funcs[prog.thread_fn[t]].nvisible;
+    for (int k = 0; k < nvisible; k++) pack_value(th.locals[k], key);
+  }
+  for (auto &g : s.globals) {
+    if (visible_global(g)) pack_value(g, key);
+    else key += char(Value::UNBOUND);
+  }
+  return key;
+}
+
+// The state as a Python dict literal (or JSON object), in the order
+// model-checker.py builds it: live threads, then globals.
+static string state_repr(const State &s, bool json = false) {
+  string out = "{", q = json ? "\"" : "'";
+  bool first = true;
+  for (size_t t = 0; t < s.threads.size(); t++) {
+    auto &th = s.threads[t];
+    if (!th.alive) continue;
+    if (!first) out += ", ";
+    first = false;
+    out += q + prog.thread_names[t] + q + ": " + (json ? "[" : "(") + std::to_string(th.line) + ", {";
+    auto &fn = prog.funcs[prog.thread_fn[t]];
+    bool first_local = true;
+    for (int k = 0; k < fn.nvisible; k++) {
+      if (th.locals[k].kind == Value::UNBOUND) continue;
+      if (!first_local) out += ", ";
+      first_local = false;
+      out += q + fn.local_names[k] + q + ": ";
+      repr(th.locals[k], out, json);
+    }
+    out += json ? "}]" : "})";
+  }
+  for (size_t g = 0; g < s.globals.size(); g++) {
+    if (!visible_global(s.globals[g])) continue;
+    if (!first) out += ", ";
+    first = false;
+    out += q + prog.gvar_names[g] + q + ": ";
+    repr(s.globals[g], out, json);
+  }
+  return out + "}";
+}
+
+// Interpreter
+
+#define STEP_LIMIT 100000000L  // Instructions without reaching a checkpoint
+
+struct Exec {
+  State *state;        // Globals live here
+  const State *marked; // For markers: the state passed to localvar()
+  long budget;
+  uint64_t reads = 0, writes = 0;  // Globals touched (bit g % 64)
+};
+
+static inline uint64_t gbit(int g) { return 1ULL << (g % 64); }
+
+static long index_of(long idx, size_t len) {
+  if (idx < 0) idx += len;
+  if (idx < 0 || idx >= (long)len) panic("index out of range");
+  return idx;
+}
+
+static Value binop(int op, const Value &a, const Value &b) {
+  if (a.is_int() && b.is_int()) {
+    switch (op) {
+      case ADD: return Value::integer(a.i + b.i);
+      case SUB: return Value::integer(a.i - b.i);
+      case MUL: return Value::integer(a.i * b.i);
+      case MOD: case FLOORDIV: {
+        if (b.i == 0) panic("division by zero");
+        long q = a.i / b.i, r = a.i % b.i;
+        if (r != 0 && ((r < 0) != (b.i < 0))) { q--; r += b.i; }
+        return Value::integer(op == MOD ? r : q);
+      }
+    }
+  }
+  if (op == ADD && a.kind == Value::STR && b.kind == Value::STR) {
+    return Value::str(a.s + b.s);
+  }
+  if (op == ADD && a.is_seq() && a.kind == b.kind) {
+    Value r = a;
+    r.items.insert(r.items.end(), b.items.begin(), b.items.end());
+    return r;
+  }
+  if (op == MUL && (a.kind == Value::STR || a.is_seq()) && b.is_int()) {
+    Value r = a;
+    r.s.clear();
+    r.items.clear();
+    for (long k = 0; k < b.i; k++) {
+      r.s += a.s;
+      r.items.insert(r.items.end(), a.items.begin(), a.items.end());
+    }
+    return r;
+  }
+  panic(string("unsupported operand types for ") + binop_names[op]);
+}
+
+static bool contains(const Value &x, const Value &c) {
+  if (c.kind == Value::STR) {
+    if (x.kind != Value::STR) panic("'in <string>' requires a string");
+    return c.s.find(x.s) != u32string::npos;
+  }
+  if (c.is_seq()) {
+    for (auto &y : c.items) {
+      if (equal(x, y)) return true;
+    }
+    return false;
+  }
+  panic("argument of 'in' is not a container");
+}
+
+static bool cmp(int op, const Value &a, const Value &b) {
+  switch (op) {
+    case EQ: return equal(a, b);
+    case NE: return !equal(a, b);
+    case LT: return compare(a, b) < 0;
+    case LE: return compare(a, b) <= 0;
+    case GT: return compare(a, b) > 0;
+    case GE: return compare(a, b) >= 0;
+    case IN: return contains(a, b);
+    case NOTIN: return !contains(a, b);
+    // Only meaningful for None/True/False in our subset
+    case IS: return a.kind == b.kind && equal(a, b);
+    case ISNOT: return !(a.kind == b.kind && equal(a, b));
+  }
+  return false;
+}
+
+static Value subscript(const Value &v, const Value &idx) {
+  if (!idx.is_int()) panic("indices must be integers");
+  if (v.kind == Value::STR) {
+    return Value::str(u32string(1, v.s[index_of(idx.i, v.s.size())]));
+  }
+  if (v.is_seq()) return v.items[index_of(idx.i, v.items.size())];
+  panic("object is not subscriptable");
+}
+
+static void store_subscript(Value &v, const Value &idx, Value x) {
+  if (v.kind != Value::LIST) panic("object does not support item assignment");
+  if (!idx.is_int()) panic("indices must be integers");
+  v.items[index_of(idx.i, v.items.size())] = std::move(x);
+}
+
+static Value slice(const Value &v, const Value &lo, const Value &hi) {
+  long len = v.kind == Value::STR ? v.s.size() : v.items.size();
+  auto bound = [len](const Value &x, long dflt) {
+    if (x.kind == Value::NONE) return dflt;
+    long i = x.i < 0 ? x.i + len : x.i;
+    return i < 0 ? 0 : i > len ? len : i;
+  };
+  long l = bound(lo, 0), h = bound(hi, len);
+  if (h < l) h = l;
+  if (v.kind == Value::STR) return Value::str(v.s.substr(l, h - l));
+  if (v.is_seq()) {
+    return Value::seq(v.kind, vector<Value>(v.items.begin() + l, v.items.begin() + h));
+  }
+  panic("object is not sliceable");
+}
+
+static Value builtin(int id, vector<Value> &args) {
+  auto need = [&](size_t lo, size_t hi) {
+    if (args.size() < lo || args.size() > hi) panic("wrong number of arguments to a builtin");
+  };
+  switch (id) {
+    case B_LEN:
+      need(1, 1);
+      if (args[0].kind == Value::STR) return Value::integer(args[0].s.size());
+      if (args[0].is_seq()) return Value::integer(args[0].items.size());
+      panic("object has no len()");
+    case B_RANGE: {
+      need(1, 3);
+      long lo = 0, hi, step = 1;
+      if (args.size() == 1) hi = args[0].i;
+      else { lo = args[0].i; hi = args[1].i; }
+      if (args.size() == 3) step = args[2].i;
+      if (step == 0) panic("range() step must not be zero");
+      vector<Value> items;
+      for (long k = lo; step > 0 ? k < hi : k > hi; k += step) items.push_back(Value::integer(k));
+      return Value::seq(Value::LIST, items);
+    }
+    case B_ABS:
+      need(1, 1);
+      return Value::integer(args[0].i < 0 ? -args[0].i : args[0].i);
+    case B_MIN: case B_MAX: {
+      need(1, 64);
+      vector<Value> xs = args.size() == 1 ? args[0].items : args;
+      if (xs.empty()) panic("min()/max() of an empty sequence");
+      Value best = xs[0];
+      for (auto &x : xs) {
+        int c = compare(x, best);
+        if (id == B_MIN ? c < 0 : c > 0) best = x;
+      }
+      return best;
+    }
+    case B_BOOL:
+      need(1, 1);
+      return Value::boolean(truthy(args[0]));
+  }
+  panic("unknown builtin");
+}
+
+static Value localvar(const State &s, const Value &t, const Value &name) {
+  for (size_t k = 0; k < prog.thread_names.size(); k++) {
+    string tname;
+    for (char32_t c : t.s) utf8(c, tname);
+    if (tname != prog.thread_names[k]) continue;
+    auto &th = s.threads[k];
+    if (!th.alive) return Value::none();
+    auto &fn = prog.funcs[prog.thread_fn[k]];
+    string vname;
+    for (char32_t c : name.s) utf8(c, vname);
+    for (int j = 0; j < fn.nvisible; j++) {
+      if (fn.local_names[j] == vname && th.locals[j].kind != Value::UNBOUND) {
+        return th.locals[j];
+      }
+    }
+    return Value::none();
+  }
+  return Value::none();
+}
+
+// Run fn from *pc with the given locals until it returns (true, result in
+// *ret) or reaches a checkpoint (false, *line set, *pc after the YIELD).
+static bool run(const Function &fn, vector<Value> &locals, int *pc, Exec &ex,
+                Value *ret, int *line) {
+  vector<Value> stack;
+  auto pop = [&]() {
+    Value v = std::move(stack.back());
+    stack.pop_back();
+    return v;
+  };
+  auto &globals = ex.state->globals;
+
+  while (true) {
+    if (--ex.budget < 0) panic("a step of " + fn.name + " does not reach a checkpoint");
+    const Instr &ins = fn.code[(*pc)++];
+    switch (ins.op) {
+      case CONST: stack.push_back(prog.consts[ins.a]); break;
+      case LOAD_LOCAL:
+        if (locals[ins.a].kind == Value::UNBOUND) {
+          panic("local " + fn.local_names[ins.a] + " referenced before assignment");
+        }
+        stack.push_back(locals[ins.a]);
+        break;
+      case STORE_LOCAL: locals[ins.a] = pop(); break;
+      case DEL_LOCAL: locals[ins.a] = Value(); break;
+      case LOAD_GLOBAL:
+        ex.reads |= gbit(ins.a);
+        if (globals[ins.a].kind == Value::UNBOUND) {
+          panic("no attribute self." + prog.gvar_names[ins.a]);
+        }
+        stack.push_back(globals[ins.a]);
+        break;
+      case STORE_GLOBAL: ex.writes |= gbit(ins.a); globals[ins.a] = pop(); break;
+      case DEL_GLOBAL: ex.writes |= gbit(ins.a); globals[ins.a] = Value(); break;
+      case STORE_SUBSCR_LOCAL: case STORE_SUBSCR_GLOBAL: {
+        if (ins.op == STORE_SUBSCR_GLOBAL) ex.reads |= gbit(ins.a), ex.writes |= gbit(ins.a);
+        Value idx = pop(), x = pop();
+        store_subscript(ins.op == STORE_SUBSCR_LOCAL ? locals[ins.a] : globals[ins.a],
+                        idx, std::move(x));
+        break;
+      }
+      case INDEX: {
+        Value idx = pop(), v = pop();
+        stack.push_back(subscript(v, idx));
+        break;
+      }
+      case SLICE: {
+        Value hi = pop(), lo = pop(), v = pop();
+        stack.push_back(slice(v, lo, hi));
+        break;
+      }
+      case BINOP: {
+        Value b = pop(), a = pop();
+        stack.push_back(binop(ins.a, a, b));
+        break;
+      }
+      case CMP: {
+        Value b = pop(), a = pop();
+        stack.push_back(Value::boolean(cmp(ins.a, a, b)));
+        break;
+      }
+      case NOT: stack.back() = Value::boolean(!truthy(stack.back())); break;
+      case NEG:
+        if (!stack.back().is_int()) panic("bad operand type for unary -");
+        stack.back() = Value::integer(-stack.back().i);
+        break;
+      case JUMP: *pc = ins.a; break;
+      case JUMP_IF_FALSE:
+        if (!truthy(pop())) *pc = ins.a;
+        break;
+      case JUMP_IF_FALSE_OR_POP:
+        if (!truthy(stack.back())) *pc = ins.a;
+        else stack.pop_back();
+        break;
+      case JUMP_IF_TRUE_OR_POP:
+        if (truthy(stack.back())) *pc = ins.a;
+        else stack.pop_back();
+        break;
+      case BUILD_LIST: case BUILD_TUPLE: {
+        vector<Value> items(stack.end() - ins.a, stack.end());
+        stack.resize(stack.size() - ins.a);
+        stack.push_back(Value::seq(ins.op == BUILD_LIST ? Value::LIST : Value::TUPLE, items));
+        break;
+      }
+      case UNPACK: {
+        Value v = pop();
+        vector<Value> items;
+        if (v.kind == Value::STR) {
+          for (char32_t c : v.s) items.push_back(Value::str(u32string(1, c)));
+        } else if (v.is_seq()) {
+          items = v.items;
+        } else {
+          panic("cannot unpack a non-sequence");
+        }
+        if ((int)items.size() != ins.a) panic("wrong number of values to unpack");
+        for (int k = ins.a - 1; k >= 0; k--) stack.push_back(items[k]);
+        break;
+      }
+      case DUP: stack.push_back(stack.back()); break;
+      case POP: stack.pop_back(); break;
+      case FOR_ITER: {
+        Value &seq = locals[ins.b], &pos = locals[ins.b + 1];
+        long len = seq.kind == Value::STR ? seq.s.size() : seq.items.size();
+        if (seq.kind != Value::STR && !seq.is_seq()) panic("object is not iterable");
+        if (pos.i >= len) {
+          *pc = ins.a;
+        } else {
+          stack.push_back(seq.kind == Value::STR ? Value::str(u32string(1, seq.s[pos.i]))
+                                                 : seq.items[pos.i]);
+          pos.i++;
+        }
+        break;
+      }
+      case CALL: {
+        const Function &callee = prog.funcs[ins.a];
+        vector<Value> args(callee.nlocals);
+        for (int k = ins.b - 1; k >= 0; k--) args[k] = pop();
+        int callee_pc = 0, callee_line;
+        Value r;
+        if (!run(callee, args, &callee_pc, ex, &r, &callee_line)) {
+          panic("checkpoint inside " + callee.name);
+        }
+        stack.push_back(std::move(r));
+        break;
+      }
+      case CALL_BUILTIN: {
+        vector<Value> args(stack.end() - ins.b, stack.end());
+        stack.resize(stack.size() - ins.b);
+        stack.push_back(builtin(ins.a, args));
+        break;
+      }
+      case LOCALVAR: {
+        if (!ex.marked) panic("localvar() outside a marker or invariant");
+        Value name = pop(), t = pop();
+        stack.push_back(localvar(*ex.marked, t, name));
+        break;
+      }
+      case RETURN: *ret = pop(); return true;
+      case YIELD: *line = ins.a; return false;
+    }
+  }
+}
+
+struct Footprint {
+  uint64_t reads = 0, writes = 0;
+};
+
+// Advance thread t of s by one step (to its next checkpoint, or to its end).
+static Footprint step(State &s, int t) {
+  Thread &th = s.threads[t];
+  if (!th.alive) return {};
+  Exec ex = { &s, nullptr, STEP_LIMIT };
+  Value ret;
+  if (run(prog.funcs[prog.thread_fn[t]], th.locals, &th.pc, ex, &ret, &th.line)) {
+    th.alive = false;
+    th.locals.clear();
+  }
+  return { ex.reads, ex.writes };
+}
+
+static State initial_state() {
+  State s;
+  s.globals = prog.gvar_init;
+  for (size_t t = 0; t < prog.thread_fn.size(); t++) {
+    Thread th;
+    th.locals.resize(prog.funcs[prog.thread_fn[t]].nlocals);
+    s.threads.push_back(th);
+    step(s, t);  // Run to the first checkpoint, like the first next()
+  }
+  return s;
+}
+
+// Call marker or invariant f(self, state) on s.
+static Value observe(int f, const State &s) {
+  State copy = s;  // Observers see (and may scribble on) their own copy
+  Exec ex = { &copy, &s, STEP_LIMIT };
+  vector<Value> locals(prog.funcs[f].nlocals, Value::none());
+  int pc = 0, line;
+  Value r;
+  run(prog.funcs[f], locals, &pc, ex, &r, &line);
+  return r;
+}
+
+// The truthy marker results on s, each as repr() (or JSON)
+static vector<string> mark_values(const State &s, bool json = false) {
+  vector<string> out;
+  for (int f : prog.markers) {
+    Value r = observe(f, s);
+    if (truthy(r)) repr(r, out.emplace_back(), json);
+  }
+  return out;
+}
+
+static string marks(const State &s, bool json = false) {
+  string out = "[";
+  for (auto &m : mark_values(s, json)) {
+    if (out.size() > 1) out += ", ";
+    out += m;
+  }
+  return out + "]";
+}
+
+// The first invariant that does not hold in s, or -1.
+static int violated(const State &s) {
+  for (size_t k = 0; k < prog.invariants.size(); k++) {
+    if (!truthy(observe(prog.invariants[k], s))) return k;
+  }
+  return -1;
+}
+
+// Visited set: 128-bit fingerprints of the state keys, in shards that
+// each have their own lock, so that workers rarely contend. Two distinct
+// states share a fingerprint with negligible probability (~n^2 / 2^128).
+
+struct Fingerprint {
+  uint64_t hi, lo;
+  bool operator==(const Fingerprint &o) const { return hi == o.hi && lo == o.lo; }
+};
+
+struct FingerprintHash {
+  size_t operator()(const Fingerprint &f) const { return f.lo; }
+};
+
+static uint64_t fmix(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+static inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+// MurmurHash3 (x64, 128-bit)
+static Fingerprint fingerprint(const string &key) {
+  const uint64_t c1 = 0x87c37b91114253d5ULL, c2 = 0x4cf5ad432745937fULL;
+  uint64_t h1 = 0, h2 = 0;
+  size_t n = key.size(), nblocks = n / 16;
+  const char *data = key.data();
+  for (size_t k = 0; k < nblocks; k++) {
+    uint64_t k1, k2;
+    memcpy(&k1, data + 16 * k, 8);
+    memcpy(&k2, data + 16 * k + 8, 8);
+    h1 ^= rotl(k1 * c1, 31) * c2;
+    h1 = (rotl(h1, 27) + h2) * 5 + 0x52dce729;
+    h2 ^= rotl(k2 * c2, 33) * c1;
+    h2 = (rotl(h2, 31) + h1) * 5 + 0x38495ab5;
+  }
+  uint64_t k1 = 0, k2 = 0;
+  size_t tail = n & 15;
+  if (tail > 8) memcpy(&k2, data + 16 * nblocks + 8, tail - 8);
+  if (tail) memcpy(&k1, data + 16 * nblocks, tail > 8 ? 8 : tail);
+  h2 ^= rotl(k2 * c2, 33) * c1;
+  h1 ^= rotl(k1 * c1, 31) * c2;
+  h1 ^= n;
+  h2 ^= n;
+  h1 += h2;
+  h2 += h1;
+  h1 = fmix(h1);
+  h2 = fmix(h2);
+  h1 += h2;
+  h2 += h1;
+  return { h1, h2 };
+}
+
+#define NSHARD 128
+#define NO_ID UINT32_MAX
+
+struct Entry {
+  uint32_t id = NO_ID;  // Assigned when the state is numbered
+};
+
+struct Visited {
+  struct Shard {
+    std::mutex lk;
+    std::unordered_map<Fingerprint, Entry, FingerprintHash> map;  // Entries never move
+  } shards[NSHARD];
+
+  Entry *visit(const Fingerprint &fp) {
+    Shard &sh = shards[fp.hi % NSHARD];
+    std::lock_guard<std::mutex> guard(sh.lk);
+    return &sh.map[fp];
+  }
+};
+
+// Fingerprint-only visited sets, for searches that are too large for the
+// graph output (they only count states). Both identify a state by its full
+// encoding and never store it. contains() may run concurrently with other
+// contains(), but not with insert().
+struct Seen {
+  virtual ~Seen() {}
+  virtual bool contains(const Fingerprint &fp) = 0;
+  virtual bool insert(const Fingerprint &fp) = 0;  // Whether it was new
+  virtual string describe() = 0;
+};
+
+// Hash compaction: 64 bits of each fingerprint in open-addressing shards
+// (8 bytes per slot, at most 3/4 full). Two states are confused with
+// probability about n / 2^64 per insertion.
+struct CompactSet : Seen {
+  struct Shard {
+    std::mutex lk;
+    vector<uint64_t> slots = vector<uint64_t>(1024);  // 0: empty
+    size_t used = 0;
+  } shards[NSHARD];
+
+  static uint64_t tag(const Fingerprint &fp) { return fp.lo | 1; }
+
+  static uint64_t *probe(Shard &sh, uint64_t tag) {
+    size_t mask = sh.slots.size() - 1;
+    for (size_t i = (tag >> 1) & mask;; i = (i + 1) & mask) {
+      if (sh.slots[i] == tag || sh.slots[i] == 0) return &sh.slots[i];
+    }
+  }
+
+  bool contains(const Fingerprint &fp) override {
+    Shard &sh = shards[fp.hi % NSHARD];
+    return *probe(sh, tag(fp)) != 0;
+  }
+
+  bool insert(const Fingerprint &fp) override {
+    Shard &sh = shards[fp.hi % NSHARD];
+    std::lock_guard<std::mutex> guard(sh.lk);
+    uint64_t *slot = probe(sh, tag(fp));
+    if (*slot) return false;
+    *slot = tag(fp);
+    if (++sh.used * 4 > sh.slots.size() * 3) {
+      vector<uint64_t> old(sh.slots.size() * 2);
+      std::swap(old, sh.slots);
+      for (uint64_t x : old) {
+        if (x) *probe(sh, x) = x;
+      }
+    }
+    return true;
+  }
+
+  string describe() override {
+    size_t bytes = 0;
+    for (auto &sh : shards) bytes += sh.slots.size() * sizeof(uint64_t);
+    return "hash compaction, 64-bit fingerprints, " + std::to_string(bytes >> 20) + " MiB";
+  }
+};
+
+// Bitstate hashing (Holzmann's supertrace): a state sets NPROBE bits of a
+// 2^k-bit array and counts as seen when all of them are set. Memory is
+// fixed; a collision silently prunes a state, so the search may miss part
+// of the state space (less likely with more bits per state).
+#define NPROBE 3
+
+struct BitState : Seen {
+  vector<std::atomic<uint64_t>> words;
+  uint64_t mask;  // Bit index mask
+  std::atomic<size_t> ones = 0;
+
+  BitState(int k) : words(1ULL << (k > 6 ? k - 6 : 0)), mask((1ULL << k) - 1) {}
+
+  uint64_t bit(const Fingerprint &fp, int j) { return (fp.lo + j * (fp.hi | 1)) & mask; }
+
+  bool contains(const Fingerprint &fp) override {
+    for (int j = 0; j < NPROBE; j++) {
+      uint64_t b = bit(fp, j);
+      if (!(words[b >> 6].load(std::memory_order_relaxed) & (1ULL << (b & 63)))) return false;
+    }
+    return true;
+  }
+
+  bool insert(const Fingerprint &fp) override {
+    bool fresh = false;
+    for (int j = 0; j < NPROBE; j++) {
+      uint64_t b = bit(fp, j), m = 1ULL << (b & 63);
+      if (!(words[b >> 6].fetch_or(m, std::memory_order_relaxed) & m)) {
+        fresh = true;
+        ones++;
+      }
+    }
+    return fresh;
+  }
+
+  string describe() override {
+    char buf[128];
+    snprintf(buf, sizeof(buf), "bitstate, 2^%d bits, %d probes, %.3f%% set",
+             64 - __builtin_clzll(mask), NPROBE, 100.0 * ones / (mask + 1));
+    return buf;
+  }
+};
+
+// Partial-order reduction
+//
+// Expanding every thread at every state explores all interleavings of
+// steps that do not interact. Instead, a state may be expanded with a
+// single thread t (an ample set {t}) when
+//   - t's step is independent of anything the other threads can ever do:
+//     it writes no global they may read or write, and reads no global they
+//     may write (their footprints are over-approximated from their code,
+//     including the helpers they call);
+//   - t's step is invisible: it changes no global and no local of t that a
+//     marker or invariant looks at, so every marked (or violating) state
+//     stays reachable; and
+//   - t's step leads to a new state. If it reaches a state seen before,
+//     which may close a cycle, the state is fully expanded (the BFS
+//     version of the cycle proviso), so no thread is ignored forever.
+// Steps' footprints are recorded by the interpreter as they run.
+
+static vector<Footprint> thread_footprint;  // Static, per @thread function
+static uint64_t marker_reads;               // Globals read by markers/invariants
+static vector<string> marker_locals;        // Locals passed to localvar()
+static bool marker_all_locals;              // localvar() with a computed name
+
+static void analyze() {
+  // Direct footprints, then propagate through calls until nothing changes.
+  size_t n = prog.funcs.size();
+  vector<Footprint> fp(n);
+  for (size_t f = 0; f < n; f++) {
+    for (auto &ins : prog.funcs[f].code) {
+      if (ins.op == LOAD_GLOBAL) fp[f].reads |= gbit(ins.a);
+      if (ins.op == STORE_GLOBAL || ins.op == DEL_GLOBAL) fp[f].writes |= gbit(ins.a);
+      if (ins.op == STORE_SUBSCR_GLOBAL) fp[f].reads |= gbit(ins.a), fp[f].writes |= gbit(ins.a);
+    }
+  }
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (size_t f = 0; f < n; f++) {
+      for (auto &ins : prog.funcs[f].code) {
+        if (ins.op != CALL) continue;
+        Footprint merged = { fp[f].reads | fp[ins.a].reads, fp[f].writes | fp[ins.a].writes };
+        if (merged.reads != fp[f].reads || merged.writes != fp[f].writes) {
+          fp[f] = merged;
+          changed = true;
+        }
+      }
+    }
+  }
+  for (int f : prog.thread_fn) thread_footprint.push_back(fp[f]);
+
+  // What markers and invariants observe (also through the helpers they call)
+  vector<bool> seen(n);
+  vector<int> todo(prog.markers.begin(), prog.markers.end());
+  todo.insert(todo.end(), prog.invariants.begin(), prog.invariants.end());
+  while (!todo.empty()) {
+    int f = todo.back();
+    todo.pop_back();
+    if (seen[f]) continue;
+    seen[f] = true;
+    marker_reads |= fp[f].reads;
+    auto &code = prog.funcs[f].code;
+    for (size_t k = 0; k < code.size(); k++) {
+      if (code[k].op == CALL) todo.push_back(code[k].a);
+      if (code[k].op != LOCALVAR) continue;
+      if (k > 0 && code[k - 1].op == CONST && prog.consts[code[k - 1].a].kind == Value::STR) {
+        string name;
+        for (char32_t c : prog.consts[code[k - 1].a].s) utf8(c, name);
+        marker_locals.push_back(name);
+      } else {
+        marker_all_locals = true;
+      }
+    }
+  }
+}
+
+static bool invisible(const State &u, const State &v, int t, const Footprint &fp) {
+  if (fp.writes & marker_reads) return false;
+  auto &fn = prog.funcs[prog.thread_fn[t]];
+  auto &before = u.threads[t], &after = v.threads[t];
+  for (int k = 0; k < fn.nvisible; k++) {
+    bool observed = marker_all_locals;
+    for (auto &name : marker_locals) observed |= name == fn.local_names[k];
+    if (!observed) continue;
+    // A terminating thread takes all its locals with it (localvar() then
+    // returns None)
+    if (before.alive != after.alive) return false;
+    if (!(before.locals[k].kind == after.locals[k].kind &&
+          equal(before.locals[k], after.locals[k]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The thread to expand u with alone, or -1 to expand all threads.
+static int ample(const State &u, const vector<State> &succ, const vector<Footprint> &fps) {
+  for (size_t t = 0; t < u.threads.size(); t++) {
+    if (!u.threads[t].alive) continue;
+    bool independent = true;
+    for (size_t o = 0; o < u.threads.size(); o++) {
+      if (o == t || !u.threads[o].alive) continue;
+      auto &other = thread_footprint[o];
+      if ((fps[t].writes & (other.reads | other.writes)) || (fps[t].reads & other.writes)) {
+        independent = false;
+        break;
+      }
+    }
+    if (independent && invisible(u, succ[t], t, fps[t])) return t;
+  }
+  return -1;
+}
+
+// Run f(0), ..., f(n - 1) on nworker threads, in chunks.
+static int nworker = 1;
+
+template <typename F>
+static void parallel_for(size_t n, F f) {
+  const size_t chunk = 64;
+  std::atomic<size_t> next = 0;
+  auto worker = [&]() {
+    for (size_t lo; (lo = next.fetch_add(chunk)) < n;) {
+      for (size_t i = lo; i < n && i < lo + chunk; i++) f(i);
+    }
+  };
+  int nthread = std::min<size_t>(nworker, (n + chunk - 1) / chunk);
+  vector<std::thread> workers;
+  for (int k = 1; k < nthread; k++) workers.emplace_back(worker);
+  worker();
+  for (auto &w : workers) w.join();
+}
+
+// -J: print the graph as JSON lines (see model-checker.py --jsonl)
+static bool jsonl = false;
+
+struct Stats {
+  uint32_t states;
+  size_t transitions;
+  bool violated;
+};
+
+struct Edge { uint32_t u, v; uint8_t t; };
+
+// The explored graph, kept for the liveness checks (-L)
+struct Graph {
+  vector<Edge> edges;
+  vector<uint32_t> marks;  // Per state, bit k: marked mark_names[k]
+  vector<uint32_t> alive;  // Per state, bit t: thread t has not finished
+  vector<string> mark_names;
+};
+
+// Index of the first of n packed states (get(i) is the i-th) that
+// violates an invariant, or -1.
+template <typename F>
+static long first_violation(size_t n, F get) {
+  if (prog.invariants.empty()) return -1;
+  vector<char> bad(n);
+  parallel_for(n, [&](size_t i) { bad[i] = violated(unpack(get(i))) >= 0; });
+  auto it = std::find(bad.begin(), bad.end(), 1);
+  return it == bad.end() ? -1 : it - bad.begin();
+}
+
+// Replay trace (thread choices from s0): one line per state on the way,
+// with its id if ids is not empty. The last state is left in *last.
+static vector<string> replay(const vector<uint8_t> &trace, const vector<uint32_t> &ids,
+                             State *last) {
+  vector<string> lines;
+  auto name = [&](size_t k) { return ids.empty() ? string() : "s" + std::to_string(ids[k]) + " "; };
+  State s = initial_state();
+  lines.push_back("  " + name(0) + state_repr(s));
+  for (size_t k = 0; k < trace.size(); k++) {
+    step(s, trace[k]);
+    lines.push_back("  " + prog.thread_names[trace[k]] + " -> " + name(k + 1) + state_repr(s));
+  }
+  *last = std::move(s);
+  return lines;
+}
+
+// Print the trace to a state that violates an invariant to stderr.
+static void counterexample(const vector<uint8_t> &trace, const vector<uint32_t> &ids) {
+  State s;
+  vector<string> lines = replay(trace, ids, &s);
+  std::cerr << "Invariant " << prog.funcs[prog.invariants[violated(s)]].name << " violated "
+            << (ids.empty() ? "" : "in s" + std::to_string(ids.back()) + " ")
+            << "(" << trace.size() << " steps):\n";
+  for (auto &line : lines) std::cerr << line << "\n";
+}
+
+// Level-synchronous breadth-first search. Vertex ids are the discovery
+// order of a sequential BFS, which is also how model-checker.py numbers
+// them (s0, s1, ...): each level is expanded in parallel, and the edges
+// are then numbered in order, so the output does not depend on -j.
+//
+// Each new level is checked against the invariants before it is printed.
+// At the first violating state (in id order), the search stops as
+// model-checker.py does: the graph up to that state is printed, then the
+// path through which BFS discovered it, which is a shortest one.
+static Stats explore(bool por, bool print, Graph *g = nullptr) {
+  struct Parent { uint32_t u; uint8_t t; };
+  auto visited = std::make_unique<Visited>();
+  vector<std::pair<string, uint32_t>> frontier, next;  // Packed states
+  vector<Edge> edges;
+  vector<Parent> parent;    // Edge that discovered each state (if invariants)
+  vector<size_t> edge_end;  // Edges up to the discovery of each state in next
+  uint32_t nstates = 0;
+  long bad = -1;
+  size_t nthread = prog.thread_fn.size();
+
+  auto print_states = [&](const vector<std::pair<string, uint32_t>> &states) {
+    if (!print) return;
+    vector<string> lines(states.size());
+    parallel_for(states.size(), [&](size_t i) {
+      State s = unpack(states[i].first);
+      string id = std::to_string(states[i].second);
+      if (jsonl) {
+        lines[i] = "{\"state\": " + id + ", \"value\": " + state_repr(s, true) +
+                   ", \"marks\": " + marks(s, true) + "}\n";
+      } else {
+        lines[i] = "STATE('s" + id + "', " + state_repr(s) + ", " + marks(s) + ")\n";
+      }
+    });
+    for (auto &line : lines) std::cout << line;
+  };
+
+  auto record = [&](const vector<std::pair<string, uint32_t>> &states) {
+    if (!g) return;
+    vector<vector<string>> found(states.size());
+    vector<uint32_t> alive(states.size());
+    parallel_for(states.size(), [&](size_t i) {
+      State s = unpack(states[i].first);
+      found[i] = mark_values(s);
+      for (size_t t = 0; t < nthread; t++) alive[i] |= uint32_t(s.threads[t].alive) << t;
+    });
+    for (size_t i = 0; i < states.size(); i++) {
+      uint32_t bits = 0;
+      for (auto &m : found[i]) {
+        auto it = std::find(g->mark_names.begin(), g->mark_names.end(), m);
+        if (it == g->mark_names.end()) {
+          if (g->mark_names.size() == 32) panic("too many distinct marks");
+          it = g->mark_names.insert(it, m);
+        }
+        bits |= 1u << (it - g->mark_names.begin());
+      }
+      g->marks.push_back(bits);
+      g->alive.push_back(alive[i]);
+    }
+  };
+
+  auto check = [&](vector<std::pair<string, uint32_t>> &states) {
+    bad = first_violation(states.size(), [&](size_t i) -> auto & { return states[i].first; });
+    if (bad >= 0) {
+      states.resize(bad + 1);
+      bad = states[bad].second;
+    }
+  };
+
+  State s0 = initial_state();
+  visited->visit(fingerprint(state_key(s0)))->id = nstates++;
+  frontier.emplace_back(pack(s0), 0);
+  parent.push_back({ 0, 0 });
+  check(frontier);
+  record(frontier);
+  print_states(frontier);
+
+  while (!frontier.empty() && bad < 0) {
+    // Step every thread of every state; look up the successors that will
+    // be kept (all of them, or the ample one).
+    vector<string> succ(frontier.size() * nthread);
+    vector<Fingerprint> fps(succ.size());
+    vector<Entry *> entry(succ.size());
+    vector<int> chosen(frontier.size(), -1);
+    parallel_for(frontier.size(), [&](size_t i) {
+      State u = unpack(frontier[i].first);
+      vector<State> vs(nthread, u);
+      vector<Footprint> footprints(nthread);
+      for (size_t t = 0; t < nthread; t++) {
+        footprints[t] = step(vs[t], t);
+        succ[i * nthread + t] = pack(vs[t]);
+        fps[i * nthread + t] = fingerprint(state_key(vs[t]));
+      }
+      if (por) chosen[i] = ample(u, vs, footprints);
+      for (size_t t = 0; t < nthread; t++) {
+        if (chosen[i] < 0 || chosen[i] == (int)t) {
+          entry[i * nthread + t] = visited->visit(fps[i * nthread + t]);
+        }
+      }
+    });
+
+    // Number new states in sequential order.
+    next.clear();
+    edge_end.clear();
+    auto keep = [&](size_t i, size_t t) {
+      size_t pos = i * nthread + t;
+      Entry *e = entry[pos] ? entry[pos] : visited->visit(fps[pos]);
+      bool fresh = e->id == NO_ID;
+      if (fresh) {
+        e->id = nstates++;
+        next.emplace_back(std::move(succ[pos]), e->id);
+        if (!prog.invariants.empty()) parent.push_back({ frontier[i].second, (uint8_t)t });
+      }
+      edges.push_back({ frontier[i].second, e->id, (uint8_t)t });
+      if (fresh) edge_end.push_back(edges.size());
+    };
+    for (size_t i = 0; i < frontier.size(); i++) {
+      int t = chosen[i];
+      if (t >= 0 && entry[i * nthread + t]->id == NO_ID) {
+        keep(i, t);
+      } else {
+        for (size_t t = 0; t < nthread; t++) keep(i, t);  // Proviso: expand fully
+      }
+    }
+    check(next);
+    if (bad >= 0) {
+      // Forget what was found after the violating state.
+      edges.resize(edge_end[next.size() - 1]);
+      nstates = bad + 1;
+    }
+    record(next);
+    print_states(next);
+    std::swap(frontier, next);
+  }
+
+  if (print) {
+    for (auto &e : edges) {
+      if (jsonl) {
+        std::cout << "{\"trans\": [" << e.u << ", " << e.v << ", \""
+                  << prog.thread_names[e.t] << "\"]}\n";
+      } else {
+        std::cout << "TRANS('s" << e.u << "', 's" << e.v << "', '"
+                  << prog.thread_names[e.t] << "')\n";
+      }
+    }
+    std::cout << std::flush;
+  }
+  if (bad >= 0) {
+    vector<uint8_t> trace;
+    vector<uint32_t> ids = { (uint32_t)bad };
+    for (uint32_t v = bad; v != 0; v = parent[v].u) {
+      trace.push_back(parent[v].t);
+      ids.push_back(parent[v].u);
+    }
+    std::reverse(trace.begin(), trace.end());
+    std::reverse(ids.begin(), ids.end());
+    counterexample(trace, ids);
+  }
+  size_t nedges = edges.size();
+  if (g) g->edges = std::move(edges);
+  return { nstates, nedges, bad >= 0 };
+}
+
+// The same search without ids or output, over a fingerprint-only set.
+// States are identified by their full encoding, so the set of explored
+// states (and so every count) does not depend on the order in which
+// workers insert them, except for bitstate collisions.
+//
+// For counterexamples, each level keeps the frontier index of every
+// state's parent (8 bytes per state, only when there are invariants).
+static Stats explore_compact(bool por, Seen &seen) {
+  struct Result {
+    vector<string> next;
+    vector<string> marks;
+    vector<uint8_t> via;  // Thread that reached each of next
+    size_t transitions = 0;
+  };
+  struct Parent { uint32_t i; uint8_t t; };
+  vector<string> frontier;
+  vector<vector<Parent>> levels;
+  std::unordered_map<string, size_t> marked;
+  uint32_t nstates = 1;
+  size_t transitions = 0, nthread = prog.thread_fn.size();
+  auto violation = [&]() {
+    return first_violation(frontier.size(), [&](size_t i) -> auto & { return frontier[i]; });
+  };
+
+  State s0 = initial_state();
+  frontier.push_back(pack(s0));
+  seen.insert(fingerprint(frontier[0]));
+  marked[marks(s0)]++;
+  long bad = violation();
+
+  while (!frontier.empty() && bad < 0) {
+    // With reduction, decide every state's ample thread before this level
+    // inserts anything: a successor already seen then lies on this level or
+    // an earlier one, which is what the cycle proviso needs.
+    vector<int> chosen(frontier.size(), -1);
+    if (por) {
+      parallel_for(frontier.size(), [&](size_t i) {
+        State u = unpack(frontier[i]);
+        vector<State> vs(nthread, u);
+        vector<Footprint> footprints(nthread);
+        for (size_t t = 0; t < nthread; t++) footprints[t] = step(vs[t], t);
+        int t = ample(u, vs, footprints);
+        if (t >= 0 && !seen.contains(fingerprint(pack(vs[t])))) chosen[i] = t;
+      });
+    }
+
+    vector<Result> results(frontier.size());
+    parallel_for(frontier.size(), [&](size_t i) {
+      State u = unpack(frontier[i]);
+      for (size_t t = 0; t < nthread; t++) {
+        if (chosen[i] >= 0 && chosen[i] != (int)t) continue;
+        State v = u;
+        step(v, t);
+        string bytes = pack(v);
+        results[i].transitions++;
+        if (seen.insert(fingerprint(bytes))) {
+          results[i].marks.push_back(marks(v));
+          results[i].next.push_back(std::move(bytes));
+          results[i].via.push_back(t);
+        }
+      }
+    });
+
+    frontier.clear();
+    if (!prog.invariants.empty()) levels.emplace_back();
+    for (size_t i = 0; i < results.size(); i++) {
+      auto &r = results[i];
+      transitions += r.transitions;
+      nstates += r.next.size();
+      for (auto &m : r.marks) marked[m]++;
+      for (auto &bytes : r.next) frontier.push_back(std::move(bytes));
+      if (!prog.invariants.empty()) {
+        for (uint8_t t : r.via) levels.back().push_back({ (uint32_t)i, t });
+      }
+    }
+    bad = violation();
+  }
+
+  vector<std::pair<string, size_t>> summary(marked.begin(), marked.end());
+  std::sort(summary.begin(), summary.end());
+  for (auto &[m, n] : summary) {
+    if (m != "[]") std::cout << m << ": " << n << " states\n";
+  }
+  std::cout << nstates << " states, " << transitions << " transitions ("
+            << seen.describe() << ")" << std::endl;
+  bool found = bad >= 0;
+  if (found) {
+    vector<uint8_t> trace;
+    for (size_t d = levels.size(); d-- > 0;) {
+      trace.push_back(levels[d][bad].t);
+      bad = levels[d][bad].i;
+    }
+    std::reverse(trace.begin(), trace.end());
+    counterexample(trace, {});
+  }
+  return { nstates, transitions, found };
+}
+
+// Random walks (-R)
+//
+// For state spaces out of reach of a full search: the -j workers run
+// independent random schedules from s0. Each step runs one of the
+// unfinished threads, chosen uniformly, and a walk ends after `depth`
+// steps or when all threads have finished. Walk w draws from a generator
+// seeded with (seed, w), so the walks are the same for any -j. Coverage
+// is the number of distinct states (identified as in the full search)
+// hit by any walk, kept as in -H. Invariants are checked at every step:
+// the first violation stops all workers once their current walks end,
+// and the shortest violating walk is printed.
+struct Swarm {
+  size_t walks;     // 0: until the time budget runs out
+  uint32_t depth;
+  double seconds;   // Time budget (0: none), checked between walks
+  uint64_t seed;
+};
+
+static bool random_walks(const Swarm &sw) {
+  using clock = std::chrono::steady_clock;
+  auto t0 = clock::now();
+  auto deadline = t0 + std::chrono::duration_cast<clock::duration>(
+                           std::chrono::duration<double>(sw.seconds));
+  size_t walks = sw.walks ? sw.walks : SIZE_MAX, nthread = prog.thread_fn.size();
+  CompactSet hit;
+  std::atomic<size_t> next = 0, done = 0, steps = 0, unique = 0;
+  std::atomic<bool> stop = false;
+  std::mutex lk;  // Protects marked and bad
+  std::unordered_map<string, size_t> marked;
+  vector<uint8_t> bad;
+  bool found = false;
+
+  auto worker = [&]() {
+    vector<uint8_t> trace;
+    vector<uint8_t> live;
+    size_t n = 0;
+    for (size_t w; !stop && (w = next.fetch_add(1)) < walks;) {
+      if (sw.seconds > 0 && clock::now() > deadline) break;
+      std::seed_seq sseq{ sw.seed, (uint64_t)w };
+      std::mt19937_64 rng(sseq);
+      State s = initial_state();
+      trace.clear();
+      done++;
+      for (;;) {
+        if (hit.insert(fingerprint(state_key(s)))) {
+          unique++;
+          string m = marks(s);
+          if (m != "[]") {
+            std::lock_guard<std::mutex> guard(lk);
+            marked[m]++;
+          }
+        }
+        if (violated(s) >= 0) {
+          std::lock_guard<std::mutex> guard(lk);
+          if (!found || trace.size() < bad.size()) bad = trace;
+          found = stop = true;
+          break;
+        }
+        live.clear();
+        for (size_t t = 0; t < nthread; t++) {
+          if (s.threads[t].alive) live.push_back(t);
+        }
+        if (live.empty() || trace.size() == sw.depth) break;
+        uint8_t t = live[rng() % live.size()];
+        step(s, t);
+        trace.push_back(t);
+        n++;
+      }
+    }
+    steps += n;
+  };
+  vector<std::thread> workers;
+  for (int k = 1; k < nworker; k++) workers.emplace_back(worker);
+  worker();
+  for (auto &w : workers) w.join();
+
+  vector<std::pair<string, size_t>> summary(marked.begin(), marked.end());
+  std::sort(summary.begin(), summary.end());
+  for (auto &[m, n] : summary) std::cout << m << ": " << n << " states\n";
+  double elapsed = std::chrono::duration<double>(clock::now() - t0).count();
+  char secs[32];
+  snprintf(secs, sizeof(secs), "%.1fs", elapsed);
+  std::cout << done << " walks, " << steps << " steps, " << unique
+            << " unique states (" << secs << ")" << std::endl;
+  if (found) counterexample(bad, {});
+  return found;
+}
+
+// Deadlock and liveness (-L)
+//
+// These checks run on the graph built by explore(), each in time linear
+// in its size:
+//   - deadlock: some thread has not finished, but no step changes the
+//     state (a finished thread's step is a self-loop);
+//   - liveness, as in the README: from every state, a marked state that
+//     is not 'red' (a progress state) must remain reachable, unless all
+//     threads can finish;
+//   - starvation: for every such mark, whether a fair run can avoid it
+//     forever. Under weak fairness, a thread that has not finished is
+//     eventually scheduled, so such a run exists iff the states without
+//     the mark contain a strongly connected component in which every live
+//     thread takes a step. Components are found with Tarjan's algorithm.
+// Every problem comes with a shortest trace from s0; for starvation, it
+// is followed by a fair cycle that the run repeats forever.
+
+struct Csr {
+  vector<uint32_t> off, dst;  // Successors of u: dst[off[u] .. off[u + 1])
+  vector<uint8_t> thr;        // Thread of each edge
+};
+
+static Csr csr(uint32_t n, const vector<Edge> &edges, bool reverse) {
+  Csr g;
+  g.off.assign(n + 1, 0);
+  g.dst.resize(edges.size());
+  g.thr.resize(edges.size());
+  for (auto &e : edges) g.off[(reverse ? e.v : e.u) + 1]++;
+  for (uint32_t u = 0; u < n; u++) g.off[u + 1] += g.off[u];
+  vector<uint32_t> pos(g.off.begin(), g.off.end() - 1);
+  for (auto &e : edges) {
+    uint32_t k = pos[reverse ? e.v : e.u]++;
+    g.dst[k] = reverse ? e.u : e.v;
+    g.thr[k] = e.t;
+  }
+  return g;
+}
+
+// Tarjan's algorithm (iteratively) on the states u with in[u]: the
+// component of each of them, NO_ID for the others.
+static vector<uint32_t> components(const Csr &g, const vector<char> &in) {
+  uint32_t n = g.off.size() - 1, counter = 0, ncomp = 0;
+  vector<uint32_t> comp(n, NO_ID), num(n, NO_ID), low(n), stack;
+  vector<std::pair<uint32_t, uint32_t>> work;  // (state, next edge)
+  for (uint32_t root = 0; root < n; root++) {
+    if (!in[root] || num[root] != NO_ID) continue;
+    num[root] = low[root] = counter++;
+    stack.push_back(root);
+    work.push_back({ root, g.off[root] });
+    while (!work.empty()) {
+      auto [v, k] = work.back();
+      if (k < g.off[v + 1]) {
+        work.back().second++;
+        uint32_t w = g.dst[k];
+        if (!in[w]) continue;
+        if (num[w] == NO_ID) {
+          num[w] = low[w] = counter++;
+          stack.push_back(w);
+          work.push_back({ w, g.off[w] });
+        } else if (comp[w] == NO_ID) {
+          low[v] = std::min(low[v], num[w]);
+        }
+        continue;
+      }
+      work.pop_back();
+      if (!work.empty()) low[work.back().first] = std::min(low[work.back().first], low[v]);
+      if (low[v] == num[v]) {
+        uint32_t w;
+        do {
+          w = stack.back();
+          stack.pop_back();
+          comp[w] = ncomp;
+        } while (w != v);
+        ncomp++;
+      }
+    }
+  }
+  return comp;
+}
+
+static string plural(size_t n, const string &what) {
+  return std::to_string(n) + " " + what + (n == 1 ? "" : "s");
+}
+
+struct Liveness {
+  const Graph &graph;
+  uint32_t n;
+  Csr fwd;
+  vector<Edge> pred;  // Edge through which BFS discovered each state
+
+  Liveness(const Graph &graph) : graph(graph), n(graph.alive.size()),
+      fwd(csr(n, graph.edges, false)), pred(n, { NO_ID, NO_ID, 0 }) {
+    // explore() lists edges in BFS order: the first one into v found it.
+    for (auto &e : graph.edges) {
+      if (e.v != 0 && pred[e.v].u == NO_ID) pred[e.v] = e;
+    }
+  }
+
+  // A step of live thread t (not the self-loop of a finished one)
+  bool moves(uint32_t u, uint32_t k) const {
+    return fwd.dst[k] != u || (graph.alive[u] >> fwd.thr[k] & 1);
+  }
+
+  // The shortest path from s0 to u, as (thread, state) steps
+  vector<std::pair<uint8_t, uint32_t>> path_to(uint32_t u) const {
+    vector<std::pair<uint8_t, uint32_t>> path;
+    for (; u != 0; u = pred[u].u) path.push_back({ pred[u].t, u });
+    std::reverse(path.begin(), path.end());
+    return path;
+  }
+
+  // The shortest path inside component c of comp from x that ends with an
+  // edge k for which last(k) holds (BFS)
+  template <typename F>
+  vector<std::pair<uint8_t, uint32_t>> path_within(const vector<uint32_t> &comp,
+                                                   uint32_t x, F last) const {
+    std::unordered_map<uint32_t, std::pair<uint32_t, uint8_t>> from = { { x, { NO_ID, 0 } } };
+    vector<uint32_t> queue = { x };
+    for (size_t head = 0; head < queue.size(); head++) {
+      uint32_t u = queue[head];
+      for (uint32_t k = fwd.off[u]; k < fwd.off[u + 1]; k++) {
+        uint32_t w = fwd.dst[k];
+        if (comp[w] != comp[x] || !moves(u, k)) continue;
+        if (last(k)) {
+          vector<std::pair<uint8_t, uint32_t>> path = { { fwd.thr[k], w } };
+          for (uint32_t v = u; v != x; v = from[v].first) path.push_back({ from[v].second, v });
+          std::reverse(path.begin(), path.end());
+          return path;
+        }
+        if (from.emplace(w, std::make_pair(u, fwd.thr[k])).second) queue.push_back(w);
+      }
+    }
+    panic("no path inside a component");
+  }
+
+  void print(const string &title, const vector<std::pair<uint8_t, uint32_t>> &path,
+             size_t cycle = SIZE_MAX) const {
+    vector<uint8_t> trace;
+    vector<uint32_t> ids = { 0 };
+    for (auto [t, v] : path) trace.push_back(t), ids.push_back(v);
+    State last;
+    vector<string> lines = replay(trace, ids, &last);
+    std::cout << title << " (" << trace.size() << " steps):\n";
+    for (size_t k = 0; k < lines.size(); k++) {
+      if (k > 0 && k - 1 == cycle) std::cout << "  and then, forever:\n";
+      std::cout << lines[k] << "\n";
+    }
+  }
+
+  bool deadlock() const {
+    uint32_t first = NO_ID, count = 0;
+    for (uint32_t u = 0; u < n; u++) {
+      bool stuck = graph.alive[u] != 0;
+      for (uint32_t k = fwd.off[u]; k < fwd.off[u + 1] && stuck; k++) stuck = fwd.dst[k] == u;
+      if (stuck && count++ == 0) first = u;
+    }
+    if (!count) {
+      std::cout << "deadlock: none\n";
+      return false;
+    }
+    print("deadlock: " + plural(count, "state") + ", e.g., s" + std::to_string(first),
+          path_to(first));
+    return true;
+  }
+
+  // Can every state reach a state with one of the marks in progress, or
+  // one where all threads have finished?
+  bool liveness(uint32_t progress) const {
+    Csr rev = csr(n, graph.edges, true);
+    vector<char> reach(n);
+    vector<uint32_t> queue;
+    for (uint32_t u = 0; u < n; u++) {
+      if ((graph.marks[u] & progress) || !graph.alive[u]) reach[u] = 1, queue.push_back(u);
+    }
+    for (size_t head = 0; head < queue.size(); head++) {
+      uint32_t v = queue[head];
+      for (uint32_t k = rev.off[v]; k < rev.off[v + 1]; k++) {
+        if (!reach[rev.dst[k]]) reach[rev.dst[k]] = 1, queue.push_back(rev.dst[k]);
+      }
+    }
+    auto it = std::find(reach.begin(), reach.end(), 0);
+    if (it == reach.end()) {
+      std::cout << "liveness: a progress state (or the end) is reachable from every state\n";
+      return false;
+    }
+    uint32_t u = it - reach.begin();
+    print("liveness: no progress state is reachable from s" + std::to_string(u) + " (" +
+          plural(n - queue.size(), "such state") + ")", path_to(u));
+    return true;
+  }
+
+  // Is there a fair run that never visits a state with a mark in avoid?
+  bool starvation(const string &what, uint32_t avoid) const {
+    vector<char> in(n);
+    for (uint32_t u = 0; u < n; u++) in[u] = !(graph.marks[u] & avoid);
+    vector<uint32_t> comp = components(fwd, in);
+
+    // Threads that step inside each component, and its first state
+    std::unordered_map<uint32_t, std::pair<uint32_t, uint32_t>> info;  // comp -> (took, first)
+    for (uint32_t u = 0; u < n; u++) {
+      if (comp[u] == NO_ID) continue;
+      auto &[took, first] = info.try_emplace(comp[u], 0, u).first->second;
+      for (uint32_t k = fwd.off[u]; k < fwd.off[u + 1]; k++) {
+        if (comp[fwd.dst[k]] == comp[u] && moves(u, k)) took |= 1u << fwd.thr[k];
+      }
+    }
+    uint32_t x = NO_ID;
+    for (auto &[c, i] : info) {
+      auto [took, first] = i;
+      if (took && !(graph.alive[first] & ~took) && first < x) x = first;
+    }
+    if (x == NO_ID) {
+      std::cout << what << ": none\n";
+      return false;
+    }
+
+    // Lasso: to x, then a cycle through x in which every live thread steps
+    auto path = path_to(x);
+    size_t cycle = path.size();
+    uint32_t at = x;
+    for (size_t t = 0; t < prog.thread_fn.size(); t++) {
+      if (!(graph.alive[x] >> t & 1)) continue;
+      auto part = path_within(comp, at, [&](uint32_t k) { return fwd.thr[k] == t; });
+      path.insert(path.end(), part.begin(), part.end());
+      at = path.back().second;
+    }
+    if (at != x) {
+      auto part = path_within(comp, at, [&](uint32_t k) { return fwd.dst[k] == x; });
+      path.insert(path.end(), part.begin(), part.end());
+    }
+    print(what + ": a fair run avoids it forever", path, cycle);
+    return true;
+  }
+};
+
+// Run all checks; whether any of them found a problem.
+static bool check_liveness(const Graph &graph) {
+  if (prog.thread_fn.size() > 32) panic("-L supports at most 32 threads");
+  Liveness lv(graph);
+  bool found = lv.deadlock();
+  uint32_t progress = 0;
+  for (size_t k = 0; k < graph.mark_names.size(); k++) {
+    if (graph.mark_names[k] != "'red'") progress |= 1u << k;
+  }
+  if (!progress) {
+    std::cout << "liveness: no progress marks (markers returning something other than 'red')\n";
+    return found;
+  }
+  found |= lv.liveness(progress);
+  found |= lv.starvation("livelock (no progress state)", progress);
+  for (size_t k = 0; k < graph.mark_names.size(); k++) {
+    if (progress >> k & 1) found |= lv.starvation("starvation of " + graph.mark_names[k], 1u << k);
+  }
+  return found;
+}
+
+int main(int argc, char *argv[]) {
+  int opt, bitstate = 0;
+  bool por = false, compare_por = false, compact = false, live = false, walk = false;
+  bool usage = false;
+  Swarm swarm = { 0, 100, 0, 0 };
+  nworker = std::max(1u, std::thread::hardware_concurrency());
+  while ((opt = getopt(argc, argv, "j:pcHB:JLR:d:T:S:")) != -1) {
+    switch (opt) {
+      case 'j': nworker = std::max(1, atoi(optarg)); break;
+      case 'p': por = true; break;
+      case 'c': compare_por = true; break;
+      case 'H': compact = true; break;
+      case 'B': bitstate = std::clamp(atoi(optarg), 10, 40); break;
+      case 'J': jsonl = true; break;
+      case 'L': live = true; break;
+      case 'R': walk = true; swarm.walks = atol(optarg); break;
+      case 'd': swarm.depth = atoi(optarg); break;
+      case 'T': swarm.seconds = atof(optarg); break;
+      case 'S': swarm.seed = strtoull(optarg, nullptr, 0); break;
+      default: usage = true;
+    }
+  }
+  if (usage || optind >= argc) {
+    std::cerr << "Usage: " << argv[0] <<  " [-j workers] [-p] [-J] [-c | -L | -H | -B bits | -R walks] model.bc\n"
+              << "  -p  partial-order reduction\n"
+              << "  -J  print the graph as JSON lines\n"
+              << "  -L  check for deadlocks, livelocks and starvation\n"
+              << "  -c  only count states, with and without reduction\n"
+              << "  -H  only count states, keeping 64-bit fingerprints (hash compaction)\n"
+              << "  -B  only count states, in a bitstate table of 2^bits bits\n"
+              << "  -R  random walks instead of a full search (0: until -T runs out),\n"
+              << "      at most -d steps each (default 100), with seed -S" << std::endl;
+    return 1;
+  }
+  std::ifstream in(argv[optind]);
+  if (!in) panic(string("cannot open ") + argv[optind]);
+  load(in);
+  analyze();
+
+  if (walk) {
+    if (!swarm.walks && swarm.seconds <= 0) panic("-R 0 needs a time budget (-T seconds)");
+    return random_walks(swarm);
+  }
+
+  if (live) {
+    // Reduction may drop the cycles these checks look for.
+    if (por || compact || bitstate) panic("-L needs the full graph (no -p, -H or -B)");
+    Graph graph;
+    Stats st = explore(false, false, &graph);
+    std::cout << st.states << " states, " << st.transitions << " transitions" << std::endl;
+    if (st.violated) return 1;
+    return check_liveness(graph);
+  }
+
+  if (compact || bitstate) {
+    std::unique_ptr<Seen> seen;
+    if (bitstate) seen = std::make_unique<BitState>(bitstate);
+    else seen = std::make_unique<CompactSet>();
+    return explore_compact(por, *seen).violated;
+  }
+
+  if (compare_por) {
+    Stats full = explore(false, false), reduced = explore(true, false);
+    std::cout << "full: " << full.states << " states, " << full.transitions
+              << " transitions\nreduced: " << reduced.states << " states, "
+              << reduced.transitions << " transitions" << std::endl;
+    return 0;
+  }
+
+  std::ios::sync_with_stdio(false);
+  string src;
+  if (jsonl) {
+    json_str(prog.class_src.s, src);
+    std::cout << "{\"class\": " << src << "}\n";
+  } else {
+    repr(prog.class_src, src);
+    std::cout << "CLASS(" << src << ")\n";
+  }
+  Stats st = explore(por, true);
+  if (!st.violated) {
+    std::cerr << st.states << " states, " << st.transitions << " transitions" << std::endl;
+  }
+  return st.violated;
+}
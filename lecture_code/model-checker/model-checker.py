@@ -1,7 +1,8 @@
-import inspect, ast, astor, copy, sys
+import ast, astor, copy, json, sys, argparse, random, time, os
+import multiprocessing
 from pathlib import Path
 
-threads, marker_fn = [], []
+threads, marker_fn, invariant_fn = [], [], []
 
 def thread(fn):
     '''Decorate a member function as a thread'''
@@ -14,13 +15,18 @@ def marker(fn):
     global marker_fn
     marker_fn.append(fn)
 
+def invariant(fn):
+    '''Decorate a member function as a safety invariant (must hold in every state)'''
+    global invariant_fn
+    invariant_fn.append(fn)
+
 def localvar(s, t, varname):
     '''Return local variable value of thread t in state s'''
     return s.get(t, (0, {}))[1].get(varname, None)
 
 def checkpoint():
     '''Instrumented `yield checkpoint()` goes here'''
-    f = inspect.stack()[1].frame # stack[1] is the caller of checkpoint()
+    f = sys._getframe(1) # the caller of checkpoint()
     return (f.f_lineno, { k: v for k, v in f.f_locals.items() if k != 'self' })
 
 def hack(Class):
@@ -54,36 +60,47 @@ def hack(Class):
         Class.hacked, Class.hacked_src = vars[Class.__name__], hacked_src
     return Class
 
-def execute(Class, trace):
-    '''Execute trace (like [0,0,0,2,2,1,1,1]) on Class'''
-    def attrs(obj):
-        for attr in dir(obj):
-            val = getattr(obj, attr)
-            if not attr.startswith('__') and type(val) in [bool, int, str, list, tuple, dict]:
-                yield attr, val
-
-    obj = hack(Class).hacked()
-    for attr, val in attrs(obj):
-        setattr(obj, attr, copy.deepcopy(val))
- 
-    T = []
-    for t in threads:
-        fn = getattr(obj, t)
-        T.append(fn()) # a generator for a thread
-    S = { t: T[i].__next__() for i, t in enumerate(threads) }
-
-    while trace:
-        chosen, tname, trace = trace[0], threads[trace[0]], trace[1:]
+def attrs(obj):
+    '''The shared variables (attributes) of a model object'''
+    for attr in dir(obj):
+        val = getattr(obj, attr)
+        if not attr.startswith('__') and type(val) in [bool, int, str, list, tuple, dict]:
+            yield attr, val
+
+class Run:
+    '''A fresh execution of Class, advanced one step at a time'''
+    def __init__(self, Class):
+        self.obj = obj = hack(Class).hacked()
+        for attr, val in attrs(obj):
+            setattr(obj, attr, copy.deepcopy(val))
+
+        self.T = []
+        for t in threads:
+            fn = getattr(obj, t)
+            self.T.append(fn()) # a generator for a thread
+        self.S = { t: self.T[i].__next__() for i, t in enumerate(threads) }
+
+    def step(self, chosen):
+        '''Run thread #chosen to its next checkpoint (if it is not finished)'''
         try:
-            if T[chosen]:
-                S[tname] = T[chosen].__next__()
+            if self.T[chosen]:
+                self.S[threads[chosen]] = self.T[chosen].__next__()
         except StopIteration:
-            S.pop(tname)
-            T[chosen] = None
+            self.S.pop(threads[chosen])
+            self.T[chosen] = None
 
-    for attr, val in attrs(obj):
-        S[attr] = val
-    return obj, S
+    def state(self):
+        S = dict(self.S)
+        for attr, val in attrs(self.obj):
+            S[attr] = val
+        return S
+
+def execute(Class, trace):
+    '''Execute trace (like [0,0,0,2,2,1,1,1]) on Class'''
+    run = Run(Class)
+    for chosen in trace:
+        run.step(chosen)
+    return run.obj, run.state()
 
 class State:
     def __init__(self, Class, trace):
@@ -104,42 +121,149 @@ class State:
             ))
         raise ValueError('Cannot freeze')
 
-def serialize(Class, s0, vertices, edges):
-    '''Serialize all model checking results'''
-    print(f'CLASS({repr(Class.hacked_src)})')
+def serialize(Class, s0, vertices, edges, jsonl=False):
+    '''Serialize all model checking results (as Python calls or JSON lines)'''
+    def emit(rec):
+        print(json.dumps(rec, ensure_ascii=False))
 
     sid = { s0.name: 0 }
-    def name(s):
+    def num(s):
         if s.name not in sid: 
             sid[s.name] = len(sid)
-        return repr(f's{sid[s.name]}')
+        return sid[s.name]
+    name = lambda s: repr(f's{num(s)}')
+
+    if jsonl: emit({'class': Class.hacked_src})
+    else: print(f'CLASS({repr(Class.hacked_src)})')
 
     for u in vertices.values():
         mk = [f(u.obj, u.state) for f in marker_fn if f(u.obj, u.state)]
-        print(f'STATE({name(u)}, {repr(u.state)}, {repr(mk)})')
+        if jsonl: emit({'state': num(u), 'value': u.state, 'marks': mk})
+        else: print(f'STATE({name(u)}, {repr(u.state)}, {repr(mk)})')
 
     for u, v, chosen in edges:
-        print(f'TRANS({name(u)}, {name(v)}, {repr(threads[chosen])})')
+        if jsonl: emit({'trans': [num(u), num(v), threads[chosen]]})
+        else: print(f'TRANS({name(u)}, {name(v)}, {repr(threads[chosen])})')
 
-def check_bfs(Class):
+def violated(obj, state):
+    '''Return the name of the first @mc.invariant that does not hold in state'''
+    for f in invariant_fn:
+        if not f(obj, state):
+            return f.__name__
+
+def counterexample(Class, trace, inv, vertices=None):
+    '''Report trace from s0 to a violating state (with state ids if vertices are given)'''
+    sid = list(vertices or [])
+    name = lambda u: f's{sid.index(u.name)} ' if vertices else ''
+    where = f'in {name(State(Class, trace))}' if vertices else ''
+    print(f'Invariant {inv} violated {where}'
+          f'({len(trace)} steps):', file=sys.stderr)
+    for i in range(len(trace) + 1):
+        u = State(Class, trace[:i])
+        step = f'{threads[trace[i - 1]]} -> ' if i else ''
+        print(f'  {step}{name(u)}{repr(u.state)}', file=sys.stderr)
+
+def check_bfs(Class, jsonl=False):
     '''Enumerate all possible thread interleavings of @mc.thread functions'''
     s0 = State(Class, trace=[])
 
-    # breadth-first search to find all possible thread interleavings
+    # breadth-first search to find all possible thread interleavings;
+    # stop at the first state that violates an invariant
     queue, vertices, edges = [s0], {s0.name: s0}, []
-    while queue:
+    bad = (s0, violated(s0.obj, s0.state))
+    while queue and not bad[1]:
         u, queue = queue[0], queue[1:]
         for chosen, _ in enumerate(threads):
             v = State(Class, u.trace + [chosen])
             if v.name not in vertices:
                 queue.append(v)
                 vertices[v.name] = v
+                bad = (v, violated(v.obj, v.state))
             edges.append((u, v, chosen))
+            if bad[1]: break
+
+    # the graph explored so far, then the counterexample (if any)
+    serialize(Class, s0, vertices, edges, jsonl)
+    if bad[1]:
+        # a shortest trace: BFS found the violating state first
+        counterexample(Class, bad[0].trace, bad[1], vertices)
+        sys.exit(1)
+
+def random_walks(walks, depth, deadline, seed):
+    '''A swarm worker: run random schedules (walks) of at most depth steps each'''
+    hit, steps, done = set(), 0, 0
+    for w in walks:
+        if time.time() >= deadline or swarm_stop.is_set():
+            break
+        # walk w is the same schedule whichever worker runs it
+        rng, run, trace, done = random.Random((seed << 32) + w), Run(swarm_class), [], done + 1
+        while True:
+            state = run.state()
+            hit.add(State.freeze(state).__hash__())
+            if inv := violated(run.obj, state):
+                swarm_stop.set()
+                return hit, steps, done, (trace, inv)
+            live = [i for i, g in enumerate(run.T) if g]
+            if not live or len(trace) == depth:
+                break
+            chosen = rng.choice(live)
+            run.step(chosen)
+            trace.append(chosen)
+            steps += 1
+    return hit, steps, done, None
+
+def check_random(Class, walks, depth, workers, seconds=0, seed=0):
+    '''Swarm testing: many independent random schedules in parallel worker processes
 
-    serialize(Class, s0, vertices, edges)
+    Each step runs one of the unfinished threads (chosen at random) to its
+    next checkpoint; a walk ends after depth steps or when all threads have
+    finished. Coverage is the number of distinct states hit by any walk.
+    The first invariant violation stops all workers.
+    '''
+    global swarm_class, swarm_stop
+    # workers are forked, so they inherit the instrumented class as is
+    ctx = multiprocessing.get_context('fork')
+    swarm_class, swarm_stop = hack(Class), ctx.Event()
+    deadline = time.time() + seconds if seconds else float('inf')
+    walks = walks or sys.maxsize
+
+    t0 = time.time()
+    with ctx.Pool(workers) as pool:
+        results = pool.starmap(random_walks,
+            [(range(i, walks, workers), depth, deadline, seed) for i in range(workers)])
+
+    hit = set().union(*(r[0] for r in results))
+    print(f'{sum(r[2] for r in results)} walks, {sum(r[1] for r in results)} steps, '
+          f'{len(hit)} unique states ({time.time() - t0:.1f}s)')
+    bad = [r[3] for r in results if r[3]]
+    if bad:
+        counterexample(Class, *min(bad, key=lambda b: len(b[0])))
+        sys.exit(1)
+
+def load(path):
+    '''Load the model class (with its @mc.thread/@mc.marker/@mc.invariant functions)'''
+    src, vars = Path(path).read_text(), {}
+    exec(src, globals(), vars)
+    Class = [C for C in vars.values() if type(C) == type].pop()
+    setattr(Class, 'source', src)
+    return Class
 
-src, vars = Path(sys.argv[1]).read_text(), {}
-exec(src, globals(), vars)
-Class = [C for C in vars.values() if type(C) == type].pop()
-setattr(Class, 'source', src)
-check_bfs(Class)
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Explore all interleavings of a model')
+    parser.add_argument('model', help='Python file with the model class')
+    parser.add_argument('--jsonl', '-j', help='Print the graph as JSON lines', action='store_true')
+    parser.add_argument('--random', '-r', metavar='WALKS', type=int,
+        help='Random walks instead of a full search (0: until the time budget runs out)')
+    parser.add_argument('--depth', '-d', type=int, default=100, help='Steps per random walk')
+    parser.add_argument('--time', '-t', type=float, default=0, help='Time budget in seconds')
+    parser.add_argument('--workers', '-w', type=int, default=os.cpu_count(),
+        help='Worker processes for random walks')
+    parser.add_argument('--seed', type=int, default=0, help='Seed for random walks')
+    args = parser.parse_args()
+    if args.random is None:
+        check_bfs(load(args.model), args.jsonl)
+    elif args.random == 0 and not args.time:
+        parser.error('--random 0 needs a time budget (--time)')
+    else:
+        check_random(load(args.model), args.random, args.depth,
+            max(1, args.workers), args.time, args.seed)
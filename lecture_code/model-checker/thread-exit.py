@@ -0,0 +1,19 @@
+class ThreadExit:
+    # Regression model for partial-order reduction (mc -p): a thread's
+    # last step, which drops its locals, is visible to markers that read
+    # them. Both threads hold 1 at the same time in exactly one state.
+
+    @thread
+    def t1(self):
+        x = 1
+        x = 2
+
+    @thread
+    def t2(self):
+        y = 1
+        y = 2
+
+    @marker
+    def mark_both_one(self, state):
+        if localvar(state, 't1', 'x') == 1 and localvar(state, 't2', 'y') == 1:
+            return 'red'
@@ -1,6 +1,7 @@
 import sys, re, graphviz, jinja2, json, markdown, argparse
+from array import array
 from pathlib import Path
-from collections import namedtuple
+from collections import namedtuple, deque
 
 TEMPLATE = Path('template.html').read_text()
 EMPTY = '␡'
@@ -13,30 +14,179 @@ COLORS = {
     'purple': '#e9d5ff'
 }
 
-Vertex = namedtuple('Vertex', 'name state marks')
+Vertex = namedtuple('Vertex', 'name state marks size', defaults=[1])
 Edge = namedtuple('Edge', 'name u v t')
 State = namedtuple('State', 'pcs lvars gvars')
 
-vertices, edges, threads = {}, [], []
+# The whole input, kept compact: vertex i is names[i], with its marks and
+# its input line (decoded only if the vertex is drawn); edges are arrays of
+# vertex and thread indices.
+names, lines, marks, index = [], [], [], {}
+eu, ev, et = array('I'), array('I'), array('B')
+threads = []
+
+# What is drawn
+vertices, edges = {}, []
 code_lines, pcmap, gvar, lvar = [], {}, [], []
 
 
 def parse_input():
+    '''Read the checker's output one line at a time. Lines are either calls
+    CLASS(src), STATE(name, state, marks) and TRANS(u, v, thread), or the
+    same records as JSON (--jsonl/-J): {"class": src}, {"state": id,
+    "value": state, "marks": marks} and {"trans": [u, v, thread]}, where
+    states are numbered 0, 1, ... in the order they appear.'''
 
     def CLASS(cl):
         global hacked_src
         hacked_src = cl
 
-    def STATE(u, state, marks):
-        vertices[u] = Vertex(name=u, state=state, marks=marks)
+    def STATE(u, state, mk):
+        index[u] = len(names)
+        add_state(u, mk)
 
     def TRANS(u, v, t):
-        edges.append(Edge(name=f'{u}-{v}', u=vertices[u], v=vertices[v], t=t))
+        add_trans(index[u], index[v], t)
+
+    def add_state(u, mk):
+        names.append(u)
+        lines.append(line)
+        marks.append(mk or None)
+
+    def add_trans(u, v, t):
         if t not in threads:
             threads.append(t)
-
-    for line in sys.stdin.readlines():
-        eval(line)
+        eu.append(u)
+        ev.append(v)
+        et.append(threads.index(t))
+
+    for line in sys.stdin:
+        if line.startswith('{'):
+            rec = json.loads(line)
+            if 'class' in rec: CLASS(rec['class'])
+            elif 'state' in rec: add_state(f's{rec["state"]}', rec['marks'])
+            elif 'trans' in rec: add_trans(*rec['trans'])
+        elif line.strip():
+            eval(line)
+
+
+def decode(i):
+    '''The state of vertex i, parsed again from its line'''
+    if lines[i].startswith('{'):
+        return json.loads(lines[i])['value']
+    return eval(lines[i], {'STATE': lambda u, state, mk: state})
+
+
+def full_view():
+    '''Draw every vertex and edge'''
+    for i, name in enumerate(names):
+        vertices[name] = Vertex(name=name, state=decode(i), marks=marks[i] or [])
+    for u, v, t in zip(eu, ev, et):
+        edges.append(Edge(name=f'{names[u]}-{names[v]}',
+                          u=vertices[names[u]], v=vertices[names[v]], t=threads[t]))
+
+
+def scc(n, succ):
+    '''Strongly connected components (Tarjan's algorithm, iteratively)'''
+    comp, num, low = [-1] * n, [-1] * n, [0] * n
+    stack, counter, ncomp = [], 0, 0
+    for root in range(n):
+        if num[root] >= 0: continue
+        num[root] = low[root] = counter
+        counter += 1
+        stack.append(root)
+        work = [(root, 0)]
+        while work:
+            v, k = work[-1]
+            if k < len(succ[v]):
+                work[-1] = (v, k + 1)
+                w = succ[v][k]
+                if num[w] < 0:
+                    num[w] = low[w] = counter
+                    counter += 1
+                    stack.append(w)
+                    work.append((w, 0))
+                elif comp[w] < 0:
+                    low[v] = min(low[v], num[w])
+                continue
+            work.pop()
+            if work:
+                u = work[-1][0]
+                low[u] = min(low[u], low[v])
+            if low[v] == num[v]:
+                while True:
+                    w = stack.pop()
+                    comp[w] = ncomp
+                    if w == v: break
+                ncomp += 1
+    return comp, ncomp
+
+
+def summary_view(limit):
+    '''Collapse every strongly connected component into one vertex (drawn as
+    its first state), and keep only the components on paths from s0 to
+    marked states. If those are still too many, keep shortest paths only,
+    to the nearest marked components first.'''
+    n = len(names)
+    succ = [[] for _ in range(n)]
+    for u, v in zip(eu, ev):
+        succ[u].append(v)
+    comp, ncomp = scc(n, succ)
+    del succ
+
+    first, size, cmarks = [None] * ncomp, [0] * ncomp, [[] for _ in range(ncomp)]
+    for i in range(n):
+        c = comp[i]
+        if first[c] is None: first[c] = i
+        size[c] += 1
+        for m in marks[i] or []:
+            if m not in cmarks[c]: cmarks[c].append(m)
+
+    cedges, csucc, cpred = set(), [set() for _ in range(ncomp)], [set() for _ in range(ncomp)]
+    for u, v, t in zip(eu, ev, et):
+        cu, cv = comp[u], comp[v]
+        if cu != cv:
+            cedges.add((cu, cv, t))
+            csucc[cu].add(cv)
+            cpred[cv].add(cu)
+
+    # Components that can reach a marked one (all of them if none is marked)
+    targets = [c for c in range(ncomp) if cmarks[c]] or list(range(ncomp))
+    keep, todo = set(targets), list(targets)
+    while todo:
+        for c in cpred[todo.pop()]:
+            if c not in keep:
+                keep.add(c)
+                todo.append(c)
+    c0 = comp[0]
+    keep.add(c0)
+
+    if len(keep) > limit:
+        parent, dist, queue = {c0: None}, {c0: 0}, deque([c0])
+        while queue:
+            c = queue.popleft()
+            for d in sorted(csucc[c]):
+                if d in keep and d not in dist:
+                    parent[d], dist[d] = c, dist[c] + 1
+                    queue.append(d)
+        keep = {c0}
+        for c in sorted((c for c in targets if c in dist), key=lambda c: (dist[c], c)):
+            path = []
+            while c is not None and c not in keep:
+                path.append(c)
+                c = parent[c]
+            if len(keep) + len(path) > limit: break
+            keep.update(path)
+
+    print(f'{n} states, {ncomp} strongly connected components, '
+          f'{len(keep)} drawn', file=sys.stderr)
+    for c in sorted(keep, key=lambda c: first[c]):
+        name = names[first[c]]
+        vertices[name] = Vertex(name=name, state=decode(first[c]), marks=cmarks[c], size=size[c])
+    for cu, cv, t in sorted(cedges):
+        if cu in keep and cv in keep:
+            u, v = vertices[names[first[cu]]], vertices[names[first[cv]]]
+            edges.append(Edge(name=f'{u.name}-{v.name}', u=u, v=v, t=threads[t]))
 
 
 def parse_src():
@@ -114,10 +264,6 @@ def reduce(tree_only=False):
     return tree, others
 
 
-parse_input()
-parse_src()
-parse_vars()
-
 parser = argparse.ArgumentParser(
     description='Visualize modeler checker outputs')
 parser.add_argument('--tree', '-t', help='Draw tree', action='store_true')
@@ -125,8 +271,25 @@ parser.add_argument('--reduce',
                     '-r',
                     help='Draw reduced graph',
                     action='store_true')
+parser.add_argument('--summary',
+                    '-s',
+                    help='Collapse cycles; draw only paths to marked states',
+                    action='store_true')
+parser.add_argument('--max-states',
+                    '-m',
+                    help='Summarize larger graphs (default 1000)',
+                    type=int,
+                    default=1000)
 args = parser.parse_args()
 
+parse_input()
+if args.summary or len(names) > args.max_states:
+    summary_view(args.max_states)
+else:
+    full_view()
+parse_src()
+parse_vars()
+
 if args.reduce or args.tree:
     edges, others = reduce(args.tree)
 else:
@@ -163,6 +326,8 @@ with g.subgraph(name='legend') as c:
                 for t1, l in lvar if t1 == t
             ]) + '}'
         label = '{' + '{' + gvals + '}' + '|' + '{' + lvals + '}' + '}'
+        if v.size > 1:  # A strongly connected component
+            label = '{' + f'{v.size} states|' + label[1:]
         label = label.replace('True', 'T').replace('False', 'F')
         c.node(v.name,
                id=v.name,